@@ -0,0 +1,374 @@
+#include <M5Unified.h>
+#include <Avatar.h>
+#include <Blitter.h>
+#include <HeadlessDisplay.h>
+#include <faces/FaceTemplates.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <new>
+#include <stdio.h>
+#include <stdlib.h>
+
+using namespace m5avatar;
+
+// Every result is printed as one CSV row:
+//   suite,case,variant,ns_per_frame
+// suite is parts, faces, blit or strip.
+//
+// Before that, frames drawn through Avatar are checked not to allocate, in
+// both render modes and every speech layout; the benchmark exits with 1 if
+// they do.
+
+const int kWidth = 320;
+const int kHeight = 240;
+
+const Expression kExpressions[] = {Expression::Happy, Expression::Angry,
+                                   Expression::Sad,   Expression::Doubt,
+                                   Expression::Sleepy, Expression::Neutral};
+const char *const kExpressionNames[] = {"happy",  "angry",  "sad",
+                                        "doubt",  "sleepy", "neutral"};
+
+// repetitions of each sweep
+int repeat = 20;
+
+// heap allocations while counting is on
+std::atomic<bool> countAllocations{false};
+std::atomic<uint32_t> allocations{0};
+std::atomic<uint32_t> frees{0};
+
+void countAllocation() {
+  if (countAllocations) {
+    allocations++;
+  }
+}
+
+#ifdef __GLIBC__
+// LovyanGFX sprites and the glyph cache call malloc directly: glibc lets the
+// program replace it, the replacement counts and forwards to glibc's own
+extern "C" {
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t count, size_t size);
+void *__libc_realloc(void *p, size_t size);
+void __libc_free(void *p);
+
+void *malloc(size_t size) {
+  countAllocation();
+  return __libc_malloc(size);
+}
+
+void *calloc(size_t count, size_t size) {
+  countAllocation();
+  return __libc_calloc(count, size);
+}
+
+void *realloc(void *p, size_t size) {
+  countAllocation();
+  return __libc_realloc(p, size);
+}
+
+void free(void *p) {
+  if (countAllocations && p != nullptr) {
+    frees++;
+  }
+  __libc_free(p);
+}
+}
+#endif
+
+void *operator new(size_t size) {
+#ifndef __GLIBC__
+  // counted by malloc otherwise
+  countAllocation();
+#endif
+  void *p = malloc(size ? size : 1);
+  if (p == nullptr) {
+    throw std::bad_alloc();
+  }
+  return p;
+}
+
+void operator delete(void *p) noexcept { free(p); }
+
+uint64_t nowNs() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+void report(const char *suite, const char *name, const char *variant,
+            uint64_t ns, uint32_t frames) {
+  printf("%s,%s,%s,%llu\n", suite, name, variant,
+         (unsigned long long)(ns / (frames ? frames : 1)));
+}
+
+// the open ratios, gazes and mouth openings each case is drawn with
+struct Pose {
+  float openRatio;
+  float gazeV;
+  float gazeH;
+  float mouthOpenRatio;
+};
+const Pose kPoses[] = {
+    {1.0f, 0.0f, 0.0f, 0.0f},  {0.5f, -1.0f, -1.0f, 0.5f},
+    {0.0f, 1.0f, 1.0f, 1.0f},  {1.0f, 1.0f, -1.0f, 0.25f},
+    {0.2f, -1.0f, 1.0f, 0.75f}};
+
+const int kPoseCount = sizeof(kPoses) / sizeof(kPoses[0]);
+
+// contexts of every pose of the expression, built before timing
+struct Contexts {
+  std::unique_ptr<DrawContext> ctx[kPoseCount];
+
+  Contexts(Expression expression, ColorPalette *palette, int colorDepth) {
+    for (int i = 0; i < kPoseCount; i++) {
+      const Pose &pose = kPoses[i];
+      ctx[i].reset(new DrawContext(
+          expression, 0.0f, palette, Gaze(pose.gazeV, pose.gazeH),
+          pose.openRatio, Gaze(pose.gazeV, pose.gazeH), pose.openRatio,
+          pose.mouthOpenRatio, "Hello", 0.0f, 1.0f, colorDepth,
+          BatteryIconStatus::discharging, 60, nullptr));
+    }
+  }
+};
+
+struct PartCase {
+  const char *name;
+  Drawable *part;
+  BoundingRect rect;
+};
+
+void benchmarkParts() {
+  PartCase cases[] = {
+      {"Eye", new Eye(8, false), BoundingRect(93, 90)},
+      {"Mouth", new Mouth(50, 90, 4, 60), BoundingRect(148, 163)},
+      {"Eyeblow", new Eyeblow(32, 4, false), BoundingRect(67, 96)},
+      {"EllipseEye", new EllipseEye(16, 16, false), BoundingRect(93, 90)},
+      {"GirlyEye", new GirlyEye(84, 84, false), BoundingRect(163, 64)},
+      {"PinkDemonEye", new PinkDemonEye(52, 134, false),
+       BoundingRect(134, 106)},
+      {"DoggyEye", new DoggyEye(false), BoundingRect(103, 80)},
+      {"RectMouth", new RectMouth(50, 90, 4, 60), BoundingRect(148, 163)},
+      {"OmegaMouth", new OmegaMouth(), BoundingRect(225, 160)},
+      {"UShapeMouth", new UShapeMouth(44, 44, 0, 16), BoundingRect(222, 160)},
+      {"DoggyMouth", new DoggyMouth(50, 90, 4, 60), BoundingRect(168, 163)},
+      {"EllipseEyebrow", new EllipseEyebrow(36, 20, false),
+       BoundingRect(67, 96)},
+      {"BowEyebrow", new BowEyebrow(160, 160, false), BoundingRect(163, 64)},
+      {"RectEyebrow", new RectEyebrow(15, 2, false), BoundingRect(67, 96)},
+      {"Effect", new Effect(), BoundingRect(0, 0)},
+      {"Balloon", new Balloon(), BoundingRect(0, 0)},
+      {"BatteryIcon", new BatteryIcon(), BoundingRect(0, 0)},
+  };
+  ColorPalette palette;
+  M5Canvas canvas;
+  canvas.setColorDepth(1);
+  canvas.createSprite(kWidth, kHeight);
+  canvas.setBitmapColor(palette.get(COLOR_PRIMARY),
+                        palette.get(COLOR_BACKGROUND));
+  for (PartCase &c : cases) {
+    for (int e = 0; e < 6; e++) {
+      Contexts contexts(kExpressions[e], &palette, 1);
+      uint32_t frames = 0;
+      uint64_t start = nowNs();
+      for (int r = 0; r < repeat; r++) {
+        for (auto &ctx : contexts.ctx) {
+          canvas.fillSprite(0);
+          c.part->draw(&canvas, c.rect, ctx.get());
+          frames++;
+        }
+      }
+      report("parts", c.name, kExpressionNames[e], nowNs() - start, frames);
+    }
+    delete c.part;
+  }
+}
+
+// draw full frames of the face on the display, every pose of an expression
+uint64_t drawFrames(Face *face, Expression expression, int colorDepth,
+                    uint32_t *frames) {
+  ColorPalette palette;
+  Contexts contexts(expression, &palette, colorDepth);
+  // the first frame allocates the buffers
+  face->invalidate();
+  face->draw(contexts.ctx[0].get());
+  uint64_t start = nowNs();
+  for (int r = 0; r < repeat; r++) {
+    for (auto &ctx : contexts.ctx) {
+      face->invalidate();
+      face->draw(ctx.get());
+      (*frames)++;
+    }
+  }
+  return nowNs() - start;
+}
+
+void benchmarkFaces(HeadlessDisplay *display) {
+  struct FaceCase {
+    const char *name;
+    Face *face;
+  } cases[] = {
+      {"Face", new Face(display)},
+      {"SimpleFace", new SimpleFace(display)},
+      {"OmegaFace", new OmegaFace(display)},
+      {"GirlyFace", new GirlyFace(display)},
+      {"GirlyFace2", new GirlyFace2(display)},
+      {"PinkDemonFace", new PinkDemonFace(display)},
+      {"DoggyFace", new DoggyFace(display)},
+  };
+  for (FaceCase &c : cases) {
+    for (int e = 0; e < 6; e++) {
+      uint32_t frames = 0;
+      uint64_t ns = drawFrames(c.face, kExpressions[e], 1, &frames);
+      report("faces", c.name, kExpressionNames[e], ns, frames);
+    }
+    delete c.face;
+  }
+}
+
+// full frames of the default face through each way of filling the strips
+void benchmarkBlit(HeadlessDisplay *display) {
+  Face *face = new Face(display);
+  char variant[32];
+  for (int depth : {1, 16}) {
+    struct BlitCase {
+      const char *name;
+      BlitMode mode;
+      float rotation;
+      float scale;
+      RenderMode render;
+    } cases[] = {
+        {"rotate_zoom", BlitMode::RotateZoom, 0.0f, 1.0f, RenderMode::Canvas},
+        {"identity", BlitMode::Auto, 0.0f, 1.0f, RenderMode::Canvas},
+        {"rotated_m5gfx", BlitMode::RotateZoom, 17.0f, 0.8f,
+         RenderMode::Canvas},
+        {"rotated_affine", BlitMode::Affine, 17.0f, 0.8f, RenderMode::Canvas},
+        {"strips_identity", BlitMode::Auto, 0.0f, 1.0f, RenderMode::Strips},
+        {"strips_rotated", BlitMode::Affine, 17.0f, 0.8f, RenderMode::Strips},
+    };
+    for (const BlitCase &c : cases) {
+      for (int threads = 1; threads <= StripPipeline::kMaxThreads;
+           threads *= 2) {
+        face->setBlitMode(c.mode);
+        face->setRenderMode(c.render);
+        face->setStripThreadCount(threads);
+        ColorPalette palette;
+        DrawContext ctx(Expression::Neutral, 0.0f, &palette, Gaze(), 1.0f,
+                        Gaze(), 1.0f, 0.0f, "", c.rotation, c.scale, depth,
+                        BatteryIconStatus::invisible, 0, nullptr);
+        uint32_t frames = 0;
+        uint64_t start = nowNs();
+        for (int r = 0; r < repeat * 5; r++) {
+          face->invalidate();
+          face->draw(&ctx);
+          frames++;
+        }
+        snprintf(variant, sizeof(variant), "%dbit_%dthreads", depth,
+                 threads);
+        report("blit", c.name, variant, nowNs() - start, frames);
+      }
+    }
+  }
+  delete face;
+}
+
+// resample one strip of a rotated canvas with the library's affine blitter
+// or with pushRotateZoom
+void benchmarkStrip(HeadlessDisplay *display) {
+  const int size = 320;
+  for (int depth : {1, 8, 16}) {
+    M5Canvas canvas(display);
+    canvas.setColorDepth(depth);
+    canvas.createSprite(size, size);
+    canvas.setBitmapColor(TFT_WHITE, TFT_BLACK);
+    canvas.fillCircle(size / 2, size / 2, size / 3,
+                      depth == 1 ? 1 : TFT_WHITE);
+    M5Canvas strip(display);
+    strip.setColorDepth(display->getColorDepth());
+    strip.createSprite(size, 8);
+    char variant[16];
+    snprintf(variant, sizeof(variant), "%dbit", depth);
+    for (bool affine : {false, true}) {
+      const uint32_t strips = repeat * 200;
+      uint64_t start = nowNs();
+      for (uint32_t i = 0; i < strips; i++) {
+        int y = (i * 8) % size;
+        if (affine) {
+          affineToStrip(&canvas, size / 2, size / 2 - y, 30.0f, 0.9f, size,
+                        &strip, TFT_WHITE, TFT_BLACK);
+        } else {
+          strip.clear();
+          canvas.pushRotateZoom(&strip, size / 2, size / 2 - y, 30.0f, 0.9f,
+                                0.9f);
+        }
+      }
+      report("strip", affine ? "affine" : "m5gfx", variant, nowNs() - start,
+             strips);
+    }
+  }
+}
+
+// a steady-state frame must not touch the heap
+bool checkAllocations(HeadlessDisplay *display, RenderMode render,
+                      SpeechLayout layout, const char *name) {
+  Avatar avatar(display);
+  avatar.getFace()->setRenderMode(render);
+  avatar.setSpeechLayout(layout);
+  avatar.setSpeechText(layout == SpeechLayout::Line
+                           ? "Hello"
+                           : "Hello, this speech is too long for one line");
+  allocations = 0;
+  frees = 0;
+  const uint32_t frames = 100;
+  for (uint32_t i = 0; i < frames * 2; i++) {
+    // only the frame is counted, the setters copy the state
+    avatar.setMouthOpenRatio((i % 10) / 10.0f);
+    avatar.setEyeOpenRatio((i % 3) / 2.0f);
+    avatar.setRightGaze(kPoses[i % kPoseCount].gazeV,
+                        kPoses[i % kPoseCount].gazeH);
+    // the first frames allocate the canvas and the strips
+    countAllocations = i >= frames;
+    avatar.draw();
+    countAllocations = false;
+  }
+  if (allocations > 0 || frees > 0) {
+    fprintf(stderr, "%s: %u allocations and %u frees in %u frames\n", name,
+            static_cast<unsigned>(allocations.load()),
+            static_cast<unsigned>(frees.load()),
+            static_cast<unsigned>(frames));
+    return false;
+  }
+  return true;
+}
+
+// usage: benchmark [repeat]
+int main(int argc, char **argv) {
+  if (argc > 1) {
+    repeat = atoi(argv[1]);
+  }
+  HeadlessDisplay display(kWidth, kHeight);
+  if (!display.isReady()) {
+    fprintf(stderr, "failed to allocate the framebuffer\n");
+    return 1;
+  }
+  const char *const layoutNames[] = {"line", "wrap", "ticker"};
+  char name[32];
+  for (RenderMode render : {RenderMode::Canvas, RenderMode::Strips}) {
+    for (int l = 0; l < 3; l++) {
+      snprintf(name, sizeof(name), "%s_%s",
+               render == RenderMode::Canvas ? "canvas" : "strips",
+               layoutNames[l]);
+      if (!checkAllocations(&display, render, static_cast<SpeechLayout>(l),
+                            name)) {
+        return 1;
+      }
+    }
+  }
+  printf("suite,case,variant,ns_per_frame\n");
+  benchmarkParts();
+  benchmarkFaces(&display);
+  benchmarkBlit(&display);
+  benchmarkStrip(&display);
+  return 0;
+}
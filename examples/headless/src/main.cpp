@@ -0,0 +1,47 @@
+#include <M5Unified.h>
+#include <Avatar.h>
+#include <HeadlessDisplay.h>
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+using namespace m5avatar;
+
+// usage: headless [frames] [width] [height] [output.ppm]
+int main(int argc, char **argv)
+{
+  int frames = argc > 1 ? atoi(argv[1]) : 1000;
+  int width = argc > 2 ? atoi(argv[2]) : 320;
+  int height = argc > 3 ? atoi(argv[3]) : 240;
+  const char *output = argc > 4 ? argv[4] : "headless.ppm";
+
+  HeadlessDisplay display(width, height);
+  if (!display.isReady()) {
+    fprintf(stderr, "failed to allocate the framebuffer\n");
+    return 1;
+  }
+  Face *face = new Face(&display);
+  ColorPalette palette;
+
+  uint32_t start = lgfx::micros();
+  for (int i = 0; i < frames; i++) {
+    // talk and breathe so that every frame has something to draw
+    float breath = sinf(i * 2 * M_PI / 100.0f);
+    float mouth = (i % 20) / 20.0f;
+    DrawContext ctx(Expression::Neutral, breath, &palette, Gaze(), 1.0f,
+                    Gaze(), 1.0f, mouth, "", 0.0f, 1.0f, 1,
+                    BatteryIconStatus::invisible, 0, nullptr);
+    face->draw(&ctx);
+  }
+  uint32_t elapsed = lgfx::micros() - start;
+  printf("frames,us_per_frame,fps\n");
+  printf("%d,%.1f,%.1f\n", frames, elapsed / (float)frames,
+         frames * 1000000.0f / elapsed);
+
+  if (!display.savePPM(output)) {
+    fprintf(stderr, "failed to write %s\n", output);
+  }
+  delete face;
+  return 0;
+}
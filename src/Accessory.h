@@ -5,6 +5,34 @@
 #ifndef ACCESSORY_H_
 #define ACCESSORY_H_
 
-// TODO(meganetaaan): Accessory
+#include "BoundingRect.h"
+#include "Drawable.h"
+
+namespace m5avatar {
+/**
+ * Layers of the face, composed from the bottom up
+ *
+ * Static holds what changes with the expression at most (the eyebrows),
+ * Dynamic what moves every few frames (the eyes and the mouth) and Overlay
+ * what is drawn over the face (the balloon and the effects).
+ */
+enum class FaceLayer { Static, Dynamic, Overlay };
+
+constexpr int kFaceLayerCount = 3;
+
+/**
+ * A drawable added to a layer of the face, e.g. cheeks or glasses
+ *
+ * Accessories are not owned by the face. On the Static layer they are drawn
+ * again only when the face is redrawn as a whole or their region changes;
+ * on the other layers they are drawn every frame, so they may animate.
+ */
+struct Accessory {
+  Drawable *drawable;
+  BoundingRect position;
+  FaceLayer layer;
+};
+
+}  // namespace m5avatar
 
 #endif  // ACCESSORY_H_
@@ -4,14 +4,6 @@
 
 #include "Avatar.h"
 
-// Define display size if not already defined
-#ifndef DISPLAY_WIDTH
-#define DISPLAY_WIDTH 720
-#endif
-#ifndef DISPLAY_HEIGHT
-#define DISPLAY_HEIGHT 1280
-#endif
-
 #ifndef PI
 #define PI 3.1415926535897932384626433832795
 #endif
@@ -44,15 +36,68 @@ Avatar *DriveContext::getAvatar() { return avatar; }
 
 TaskHandle_t drawTaskHandle;
 
+// the draw task also wakes up this often without any change, e.g. to see
+// parts of the face modified without going through Avatar
+const uint32_t kIdleWakeupMs = 250;
+
+#ifdef SDL_h_
+SDL_mutex *changeMutex = nullptr;
+SDL_cond *changeCond = nullptr;
+bool changed = false;
+#endif
+
+// wake the draw task up, called whenever the avatar changes
+static void notifyDrawTask() {
+#ifdef SDL_h_
+  if (changeMutex == nullptr) {
+    return;
+  }
+  SDL_LockMutex(changeMutex);
+  changed = true;
+  SDL_CondSignal(changeCond);
+  SDL_UnlockMutex(changeMutex);
+#else
+  if (drawTaskHandle != nullptr) {
+    xTaskNotifyGive(drawTaskHandle);
+  }
+#endif
+}
+
+// sleep until notifyDrawTask() is called or the timeout expires
+static void waitForChange(uint32_t timeoutMs) {
+#ifdef SDL_h_
+  SDL_LockMutex(changeMutex);
+  if (!changed) {
+    SDL_CondWaitTimeout(changeCond, changeMutex, timeoutMs);
+  }
+  changed = false;
+  SDL_UnlockMutex(changeMutex);
+#else
+  ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(timeoutMs));
+#endif
+}
+
 TaskResult_t drawLoop(void *args) {
   DriveContext *ctx = reinterpret_cast<DriveContext *>(args);
   Avatar *avatar = ctx->getAvatar();
-  // update drawings in the display
+  uint32_t lastFrameMillis = 0;
+  // update drawings in the display when the avatar changes
   while (avatar->isDrawing()) {
+    // animated accessories are drawn at the max frame rate
+    if (!avatar->getFace()->isAnimated()) {
+      waitForChange(kIdleWakeupMs);
+    }
+    // no more frames than the max frame rate, the changes made meanwhile are
+    // drawn together in the next frame
+    uint32_t interval = 1000 / avatar->getMaxFrameRate();
+    uint32_t elapsed = lgfx::millis() - lastFrameMillis;
+    if (elapsed < interval) {
+      TaskDelay(interval - elapsed);
+    }
     if (avatar->isDrawing()) {
+      lastFrameMillis = lgfx::millis();
       avatar->draw();
     }
-    TaskDelay(10);
   }
   TaskResult();
 }
@@ -105,61 +150,37 @@ TaskResult_t facialLoop(void *args) {
 
 Avatar::Avatar(int width, int height) : Avatar(&M5.Display, width, height) {}
 
-Avatar::Avatar(M5GFX* display, int width, int height) {
-    // Use display dimensions if width/height are not specified (0)
-    int w = (width == 0) ? DISPLAY_WIDTH : width;
-    int h = (height == 0) ? DISPLAY_HEIGHT : height;
-    
-    // Calculate scaling factors
-    float scaleX = w / 320.0f;
-    float scaleY = h / 240.0f;
-    
-    // Scale mouth dimensions relative to screen size
-    uint16_t mouthMinWidth = static_cast<uint16_t>(50 * scaleX);
-    uint16_t mouthMaxWidth = static_cast<uint16_t>(90 * scaleX);
-    uint16_t mouthMinHeight = static_cast<uint16_t>(4 * scaleY);
-    uint16_t mouthMaxHeight = static_cast<uint16_t>(60 * scaleY);
-    
-    // Scale eye radius relative to screen size
-    uint16_t eyeRadius = static_cast<uint16_t>(8 * scaleX);
-    
-    // Scale eyeblow dimensions relative to screen size
-    uint16_t eyeblowWidth = static_cast<uint16_t>(32 * scaleX);
-    uint16_t eyeblowHeight = static_cast<uint16_t>(4 * scaleY);
-    
-    // Create face with custom BoundingRect
-    *this = Avatar(new Face(new Mouth(mouthMinWidth, mouthMaxWidth, mouthMinHeight, mouthMaxHeight), 
-                           new Eye(eyeRadius, false), new Eye(eyeRadius, true),
-                           new Eyeblow(eyeblowWidth, eyeblowHeight, false), 
-                           new Eyeblow(eyeblowWidth, eyeblowHeight, true), 
-                           display), 
-                  display, w, h);
+// NOTE: delegate instead of assigning a temporary Avatar to *this, since the
+// temporary's destructor would delete the face we keep.
+Avatar::Avatar(lgfx::LovyanGFX *display, int width, int height)
+    : Avatar(new Face(display, width, height), display) {
+  // a face sized by the display is laid out again in start() if the display
+  // was not initialized yet
+  fitToDisplay_ = width == 0 && height == 0;
 }
 
 Avatar::Avatar(Face *face, int width, int height) : Avatar(face, &M5.Display, width, height) {}
 
-Avatar::Avatar(Face *face, M5GFX* display, int width, int height)
+Avatar::Avatar(Face *face, lgfx::LovyanGFX *display, int width, int height)
     : face{face},
       _isDrawing{false},
-      expression{Expression::Neutral},
-      breath{0},
-      leftEyeOpenRatio_{1.0f},
-      leftGazeH_{1.0f},
-      leftGazeV_{1.0f},
-      rightEyeOpenRatio_{1.0f},
-      rightGazeH_{1.0f},
-      rightGazeV_{1.0f},
       isAutoBlink_{true},
-      mouthOpenRatio{0},
-      rotation{0.0f},
-      scale{1},
-      palette{ColorPalette()},
-      speechText{""},
-      colorDepth{1},
-      batteryIconStatus{BatteryIconStatus::invisible},
-      batteryLevel{0},
-      speechFont{nullptr} 
+      hasPresentedFrame_{false},
+      presentedKey_{0},
+      renderedFrames_{0},
+      skippedFrames_{0},
+      display_{display},
+      fitToDisplay_{false},
+      maxFrameRate_{60}
 {
+#ifdef SDL_h_
+    stateLock_ = SDL_CreateMutex();
+#else
+    stateLock_ = xSemaphoreCreateMutex();
+#endif
+#ifdef M5AVATAR_FRAME_STATS
+    face->setFrameStats(&frameStats_);
+#endif
     // If custom dimensions are provided, update the BoundingRect
     if (width > 0 && height > 0) {
         // Get the current boundingRect and update it with new dimensions
@@ -175,11 +196,59 @@ Avatar::Avatar(Face *face, M5GFX* display, int width, int height)
             face->setBoundingRect(newRect);
         }
     }
+    lockState();
+    state_.top = face->getBoundingRect()->getTop();
+    state_.left = face->getBoundingRect()->getLeft();
+    publishState();
 }
 
-Avatar::~Avatar() { delete face; }
+Avatar::~Avatar() {
+  delete face;
+#ifdef SDL_h_
+  SDL_DestroyMutex(stateLock_);
+#else
+  vSemaphoreDelete(stateLock_);
+#endif
+}
 
-void Avatar::setFace(Face *face) { this->face = face; }
+void Avatar::lockState() const {
+#ifdef SDL_h_
+  SDL_LockMutex(stateLock_);
+#else
+  xSemaphoreTake(stateLock_, portMAX_DELAY);
+#endif
+}
+
+void Avatar::unlockState() const {
+#ifdef SDL_h_
+  SDL_UnlockMutex(stateLock_);
+#else
+  xSemaphoreGive(stateLock_);
+#endif
+}
+
+void Avatar::publishState() {
+  snapshots_.back() = state_;
+  snapshots_.publish();
+  unlockState();
+  notifyDrawTask();
+}
+
+void Avatar::setFace(Face *face) {
+  // only the default face is laid out for the display in start()
+  fitToDisplay_ = fitToDisplay_ && face == this->face;
+  this->face = face;
+  // the new face starts where its bounding rect is
+  lockState();
+  state_.top = face->getBoundingRect()->getTop();
+  state_.left = face->getBoundingRect()->getLeft();
+  publishState();
+#ifdef M5AVATAR_FRAME_STATS
+  face->setFrameStats(&frameStats_);
+#endif
+  // the face may have been shown before, so its last frame is stale
+  requestRedraw();
+}
 
 Face *Avatar::getFace() const { return face; }
 
@@ -211,7 +280,10 @@ void Avatar::init(int colorDepth) {
   start(colorDepth);
 }
 
-void Avatar::stop() { _isDrawing = false; }
+void Avatar::stop() {
+  _isDrawing = false;
+  notifyDrawTask();
+}
 
 void Avatar::suspend() {
 #ifndef SDL_h_
@@ -230,9 +302,22 @@ void Avatar::start(int colorDepth) {
   if (_isDrawing) return;
   _isDrawing = true;
 
-  this->colorDepth = colorDepth;
+  // the default face built before M5.begin() is laid out for 320x240, it
+  // is laid out again in place since callers may hold it already
+  if (fitToDisplay_ && display_->width() > 0) {
+    face->resize(display_->width(), display_->height());
+  }
+
+  lockState();
+  state_.colorDepth = colorDepth;
+  state_.palette.resolve(colorDepth);
+  publishState();
   DriveContext *ctx = new DriveContext(this);
 #ifdef SDL_h_
+  if (changeMutex == nullptr) {
+    changeMutex = SDL_CreateMutex();
+    changeCond = SDL_CreateCond();
+  }
   drawTaskHandle =
       SDL_CreateThreadWithStackSize(drawLoop, "drawLoop", 2048, ctx);
   SDL_CreateThreadWithStackSize(facialLoop, "facialLoop", 1024, ctx);
@@ -256,131 +341,307 @@ void Avatar::start(int colorDepth) {
 #endif
 }
 
-void Avatar::draw() {
-  Gaze rightGaze = Gaze(this->rightGazeV_, this->rightGazeV_);
-  Gaze leftGaze = Gaze(this->leftGazeV_, this->leftGazeH_);
-  DrawContext *ctx = new DrawContext(
-      this->expression, this->breath, &this->palette, rightGaze,
-      this->rightEyeOpenRatio_, leftGaze, this->leftEyeOpenRatio_,
-      this->mouthOpenRatio, this->speechText, this->rotation, this->scale,
-      this->colorDepth, this->batteryIconStatus, this->batteryLevel,
-      this->speechFont);
-  face->draw(ctx);
-  delete ctx;
+uint32_t Avatar::getRenderKey(const AvatarState &state) {
+  Fingerprint fp;
+  fp.add(face)
+      .add(face->getRevision())
+      .add(state.expression)
+      .add(state.breath)
+      .add(state.rightGazeV)
+      .add(state.rightGazeH)
+      .add(state.leftGazeV)
+      .add(state.leftGazeH)
+      .add(state.rightEyeOpenRatio)
+      .add(state.leftEyeOpenRatio)
+      .add(state.mouthOpenRatio)
+      .add(state.speechText.c_str())
+      .add(state.speechFont)
+      .add(state.speechLayout)
+      .add(state.speechScroll)
+      .add(state.palette.get(ColorKey::Primary))
+      .add(state.palette.get(ColorKey::Secondary))
+      .add(state.palette.get(ColorKey::Background))
+      .add(state.palette.get(ColorKey::BalloonForeground))
+      .add(state.palette.get(ColorKey::BalloonBackground))
+      .add(state.rotation)
+      .add(state.scale)
+      .add(state.top)
+      .add(state.left)
+      .add(state.colorDepth)
+      .add(state.batteryIconStatus)
+      .add(state.batteryLevel);
+  // the position and the rotation are in the state, the rect only gives the
+  // size of the face, which changes on resize()
+  BoundingRect *rect = face->getBoundingRect();
+  if (rect) {
+    fp.add(rect->getWidth()).add(rect->getHeight());
+  }
+  return fp.get();
+}
+
+void Avatar::requestRedraw() {
+  hasPresentedFrame_ = false;
+  if (face) {
+    face->invalidate();
+  }
+  notifyDrawTask();
+}
+
+uint32_t Avatar::getRenderedFrameCount() const { return renderedFrames_; }
+
+void Avatar::setMaxFrameRate(uint16_t fps) {
+  maxFrameRate_ = fps > 0 ? fps : 1;
+}
+
+uint16_t Avatar::getMaxFrameRate() const { return maxFrameRate_; }
+
+uint32_t Avatar::getSkippedFrameCount() const { return skippedFrames_; }
+
+bool Avatar::draw() {
+#ifdef M5AVATAR_FRAME_STATS
+  frameStats_.beginFrame();
+#endif
+  // taking the state, up to the context with its resolved palette
+  M5AVATAR_PROBE_START(contextProbe, getFrameStats(), FramePhase::Context);
+  // the newest state published by the setters, consistent as a whole
+  AvatarState *state = &snapshots_.read();
+  uint32_t key = getRenderKey(*state);
+  // animated accessories change without any input changing
+  if (hasPresentedFrame_ && key == presentedKey_ && !face->isAnimated()) {
+    skippedFrames_++;
+    return true;
+  }
+  // refers to the snapshot instead of copying it, so a frame allocates nothing
+  DrawContext ctx(state->expression, state->breath, &state->palette,
+                  Gaze(state->rightGazeV, state->rightGazeH),
+                  state->rightEyeOpenRatio,
+                  Gaze(state->leftGazeV, state->leftGazeH),
+                  state->leftEyeOpenRatio, state->mouthOpenRatio,
+                  state->speechText.c_str(), state->rotation, state->scale,
+                  state->colorDepth, state->batteryIconStatus,
+                  state->batteryLevel, state->speechFont);
+  ctx.setSpeechLayout(state->speechLayout, state->speechScroll);
+  ctx.setPosition(state->top, state->left);
+  M5AVATAR_PROBE_STOP(contextProbe);
+  bool drawn = face->draw(&ctx);
+#ifdef M5AVATAR_FRAME_STATS
+  frameStats_.endFrame(drawn);
+#endif
+  if (drawn) {
+    hasPresentedFrame_ = true;
+    presentedKey_ = key;
+    renderedFrames_++;
+  }
+  return drawn;
+}
+
+FrameStats *Avatar::getFrameStats() {
+#ifdef M5AVATAR_FRAME_STATS
+  return &frameStats_;
+#else
+  return nullptr;
+#endif
 }
 
 bool Avatar::isDrawing() { return _isDrawing; }
 
 void Avatar::setExpression(Expression expression) {
-  suspend();
-  this->expression = expression;
-  resume();
+  lockState();
+  state_.expression = expression;
+  publishState();
 }
 
-Expression Avatar::getExpression() { return this->expression; }
+Expression Avatar::getExpression() {
+  lockState();
+  Expression expression = state_.expression;
+  unlockState();
+  return expression;
+}
 
-void Avatar::setBreath(float breath) { this->breath = breath; }
+void Avatar::setBreath(float breath) {
+  lockState();
+  state_.breath = breath;
+  publishState();
+}
 
-float Avatar::getBreath() { return this->breath; }
+float Avatar::getBreath() {
+  lockState();
+  float breath = state_.breath;
+  unlockState();
+  return breath;
+}
 
 #ifndef M_PI
 #define M_PI 3.14159265358979323846
 #endif
 void Avatar::setRotation(float degree) {
-  this->rotation = degree; // * (M_PI / 180.0f);
-  if (this->getFace() && this->getFace()->getBoundingRect()) {
-    this->getFace()->getBoundingRect()->setRotation(this->rotation);
-  }
+  lockState();
+  state_.rotation = degree; // * (M_PI / 180.0f);
+  publishState();
 }
 
 
 
 
-void Avatar::setScale(float scale) { this->scale = scale; }
+void Avatar::setScale(float scale) {
+  lockState();
+  state_.scale = scale;
+  publishState();
+}
 
 void Avatar::setPosition(int top, int left) {
   // Use LCD's top-left corner (0,0) as the reference point
-  // The BoundingRect's position is now directly set using the provided coordinates
-  this->getFace()->getBoundingRect()->setPosition(top, left);
+  // the face's bounding rect is left alone, the frame takes the position
+  // from the state like the other inputs
+  lockState();
+  state_.top = top;
+  state_.left = left;
+  publishState();
 }
 
-void Avatar::setColorPalette(ColorPalette cp) { palette = cp; }
+void Avatar::setColorPalette(ColorPalette cp) {
+  lockState();
+  state_.palette = cp;
+  state_.palette.resolve(state_.colorDepth);
+  publishState();
+}
 
-ColorPalette Avatar::getColorPalette(void) const { return this->palette; }
+ColorPalette Avatar::getColorPalette(void) const {
+  lockState();
+  ColorPalette palette = state_.palette;
+  unlockState();
+  return palette;
+}
 
-void Avatar::setMouthOpenRatio(float ratio) { this->mouthOpenRatio = ratio; }
+void Avatar::setMouthOpenRatio(float ratio) {
+  lockState();
+  state_.mouthOpenRatio = ratio;
+  publishState();
+}
 
 void Avatar::setEyeOpenRatio(float ratio) {
-  setRightEyeOpenRatio(ratio);
-  setLeftEyeOpenRatio(ratio);
+  lockState();
+  state_.rightEyeOpenRatio = ratio;
+  state_.leftEyeOpenRatio = ratio;
+  publishState();
 }
 
 void Avatar::setLeftEyeOpenRatio(float ratio) {
-  this->leftEyeOpenRatio_ = ratio;
+  lockState();
+  state_.leftEyeOpenRatio = ratio;
+  publishState();
 }
 
-float Avatar::getLeftEyeOpenRatio() { return this->leftEyeOpenRatio_; }
+float Avatar::getLeftEyeOpenRatio() {
+  lockState();
+  float ratio = state_.leftEyeOpenRatio;
+  unlockState();
+  return ratio;
+}
 
 void Avatar::setRightEyeOpenRatio(float ratio) {
-  this->rightEyeOpenRatio_ = ratio;
+  lockState();
+  state_.rightEyeOpenRatio = ratio;
+  publishState();
 }
 
-float Avatar::getRightEyeOpenRatio() { return this->rightEyeOpenRatio_; }
+float Avatar::getRightEyeOpenRatio() {
+  lockState();
+  float ratio = state_.rightEyeOpenRatio;
+  unlockState();
+  return ratio;
+}
 
 void Avatar::setIsAutoBlink(bool b) { this->isAutoBlink_ = b; }
 
 bool Avatar::getIsAutoBlink() { return this->isAutoBlink_; }
 
 void Avatar::setRightGaze(float vertical, float horizontal) {
-  this->rightGazeV_ = vertical;
-  this->rightGazeH_ = horizontal;
+  lockState();
+  state_.rightGazeV = vertical;
+  state_.rightGazeH = horizontal;
+  publishState();
 }
 
 void Avatar::getRightGaze(float *vertical, float *horizontal) {
-  *vertical = this->rightGazeV_;
-  *horizontal = this->rightGazeH_;
+  lockState();
+  *vertical = state_.rightGazeV;
+  *horizontal = state_.rightGazeH;
+  unlockState();
 }
 
 void Avatar::setLeftGaze(float vertical, float horizontal) {
-  this->leftGazeV_ = vertical;
-  this->leftGazeH_ = horizontal;
+  lockState();
+  state_.leftGazeV = vertical;
+  state_.leftGazeH = horizontal;
+  publishState();
 }
 
 void Avatar::getLeftGaze(float *vertical, float *horizontal) {
-  *vertical = this->leftGazeV_;
-  *horizontal = this->leftGazeH_;
+  lockState();
+  *vertical = state_.leftGazeV;
+  *horizontal = state_.leftGazeH;
+  unlockState();
 }
 
 void Avatar::getGaze(float *vertical, float *horizontal){
-  *vertical = 0.5f * this->leftGazeV_ + 0.5f * this->rightGazeV_;
-  *horizontal = 0.5f * this->leftGazeH_ + 0.5f * this->rightGazeH_;
+  lockState();
+  *vertical = 0.5f * state_.leftGazeV + 0.5f * state_.rightGazeV;
+  *horizontal = 0.5f * state_.leftGazeH + 0.5f * state_.rightGazeH;
+  unlockState();
 }
 
 void Avatar::setSpeechText(const char *speechText) {
-  this->speechText = String(speechText);
+  lockState();
+  state_.speechText = String(speechText);
+  publishState();
 }
 
 void Avatar::setSpeechFont(const lgfx::IFont *speechFont) {
-  this->speechFont = speechFont;
+  lockState();
+  state_.speechFont = speechFont;
+  publishState();
+}
+
+void Avatar::appendSpeechText(const char *text) {
+  lockState();
+  state_.speechText += text;
+  publishState();
+}
+
+void Avatar::setSpeechLayout(SpeechLayout layout) {
+  lockState();
+  state_.speechLayout = layout;
+  publishState();
+}
+
+void Avatar::setSpeechScroll(int32_t scroll) {
+  lockState();
+  state_.speechScroll = scroll;
+  publishState();
 }
 
 void Avatar::setBatteryIcon(bool batteryIcon) {
+  lockState();
   if (!batteryIcon) {
-    batteryIconStatus = BatteryIconStatus::invisible;
+    state_.batteryIconStatus = BatteryIconStatus::invisible;
   } else {
-    batteryIconStatus = BatteryIconStatus::unknown;
+    state_.batteryIconStatus = BatteryIconStatus::unknown;
   }
+  publishState();
 }
 
 void Avatar::setBatteryStatus(bool isCharging, int32_t batteryLevel) {
-  if (this->batteryIconStatus != BatteryIconStatus::invisible) {
+  lockState();
+  if (state_.batteryIconStatus != BatteryIconStatus::invisible) {
     if (isCharging) {
-      this->batteryIconStatus = BatteryIconStatus::charging;
+      state_.batteryIconStatus = BatteryIconStatus::charging;
     } else {
-      this->batteryIconStatus = BatteryIconStatus::discharging;
+      state_.batteryIconStatus = BatteryIconStatus::discharging;
     }
-    this->batteryLevel = batteryLevel;
+    state_.batteryLevel = batteryLevel;
   }
+  publishState();
 }
 
 }  // namespace m5avatar
@@ -8,6 +8,9 @@
 
 #include "ColorPalette.h"
 #include "Face.h"
+#include "Fingerprint.h"
+#include "FrameStats.h"
+#include "TripleBuffer.h"
 
 #ifdef SDL_h_
 typedef SDL_ThreadFunction TaskFunction_t;
@@ -15,9 +18,11 @@ typedef int BaseType_t;
 typedef unsigned int UBaseType_t;
 typedef SDL_Thread *TaskHandle_t;
 typedef int TaskResult_t;
+typedef SDL_mutex *StateLock_t;
 #define APP_CPU_NUM (1)
 #else
 typedef void TaskResult_t;
+typedef SemaphoreHandle_t StateLock_t;
 #endif
 
 #ifndef APP_CPU_NUM
@@ -30,43 +35,85 @@ typedef std::string String;
 #endif  // ARDUINO
 
 namespace m5avatar {
-class Avatar {
- private:
-  Face *face;
-  bool _isDrawing;
-  Expression expression;
-  float breath;
+/**
+ * Inputs of a frame, handed over to the renderer as a whole
+ */
+struct AvatarState {
+  Expression expression = Expression::Neutral;
+  float breath = 0.0f;
 
   // eyes variables
-  float rightEyeOpenRatio_;
-  float rightGazeV_;
-  float rightGazeH_;
+  float rightEyeOpenRatio = 1.0f;
+  float rightGazeV = 1.0f;
+  float rightGazeH = 1.0f;
 
-  float leftEyeOpenRatio_;
-  float leftGazeV_;
-  float leftGazeH_;
+  float leftEyeOpenRatio = 1.0f;
+  float leftGazeV = 1.0f;
+  float leftGazeH = 1.0f;
 
-  bool isAutoBlink_;
-
-  float mouthOpenRatio;
+  float mouthOpenRatio = 0.0f;
 
-  float rotation;
-  float scale;
+  float rotation = 0.0f;
+  float scale = 1.0f;
+  // display position of the face's top-left corner
+  int top = 0;
+  int left = 0;
   ColorPalette palette;
-  String speechText;
-  int colorDepth;
-  BatteryIconStatus batteryIconStatus;
-  int32_t batteryLevel;
-  const lgfx::IFont *speechFont;
+  String speechText = "";
+  int colorDepth = 1;
+  BatteryIconStatus batteryIconStatus = BatteryIconStatus::invisible;
+  int32_t batteryLevel = 0;
+  const lgfx::IFont *speechFont = nullptr;
+  SpeechLayout speechLayout = SpeechLayout::Line;
+  int32_t speechScroll = -1;
+};
+
+class Avatar {
+ private:
+  Face *face;
+  bool _isDrawing;
+  bool isAutoBlink_;
+
+  // the state setters write, guarded by stateLock_
+  AvatarState state_;
+  StateLock_t stateLock_;
+  // copies of state_ taken by draw() without locking, so a frame never mixes
+  // values from before and after a setter
+  TripleBuffer<AvatarState> snapshots_;
+
+  // fingerprint of the inputs of the last presented frame
+  bool hasPresentedFrame_;
+  uint32_t presentedKey_;
+  uint32_t renderedFrames_;
+  uint32_t skippedFrames_;
+
+  lgfx::LovyanGFX *display_;
+  // whether the face is the default one sized by the display
+  bool fitToDisplay_;
+  // upper limit of frames drawn per second by the draw task
+  uint16_t maxFrameRate_;
+
+  // kept without M5AVATAR_FRAME_STATS as well, so the layout of Avatar is
+  // the same in code built with and without it
+  FrameStats frameStats_;
+
+  uint32_t getRenderKey(const AvatarState &state);
+  // every change of state_ goes between these two
+  void lockState() const;
+  void unlockState() const;
+  // unlock and hand state_ over to draw()
+  void publishState();
 
  public:
-  Avatar(M5GFX* display, int width = 0, int height = 0);
+  // width and height of 0 take the size of the display
+  Avatar(lgfx::LovyanGFX *display, int width = 0, int height = 0);
   Avatar(int width = 0, int height = 0); // Default constructor using M5.Display
-  explicit Avatar(Face *face, M5GFX* display, int width = 0, int height = 0);
+  explicit Avatar(Face *face, lgfx::LovyanGFX *display, int width = 0,
+                  int height = 0);
   explicit Avatar(Face *face, int width = 0, int height = 0); // Default constructor using M5.Display
   ~Avatar();
-  Avatar(const Avatar &other) = default;
-  Avatar &operator=(const Avatar &other) = default;
+  Avatar(const Avatar &other) = delete;
+  Avatar &operator=(const Avatar &other) = delete;
   Face *getFace() const;
   ColorPalette getColorPalette() const;
   void setColorPalette(ColorPalette cp);
@@ -109,11 +156,51 @@ class Avatar {
   void setMouthOpenRatio(float ratio);
   void setSpeechText(const char *speechText);
   void setSpeechFont(const lgfx::IFont *speechFont);
+  /**
+   * @brief Add text to the end of the speech text
+   *
+   * The balloon only lays out and draws the added characters, so text can be
+   * streamed in as it is spoken.
+   */
+  void appendSpeechText(const char *text);
+  // Line by default, Wrap and Ticker show long text in a fixed box
+  void setSpeechLayout(SpeechLayout layout);
+  // Ticker only: pixels the text is scrolled by, negative follows its end
+  void setSpeechScroll(int32_t scroll);
   // Set rotation in degrees (internally converted to radians)
   void setRotation(float degree);
   void setPosition(int top, int left);
   void setScale(float scale);
-  void draw(void);
+  /**
+   * @brief Render the current state to the display
+   *
+   * Frames whose inputs (expression, breath, gaze, open ratios, speech,
+   * palette, transform and battery state) match the last presented frame
+   * are skipped.
+   *
+   * @return false if the face could not allocate its drawing buffers
+   */
+  bool draw(void);
+  // draw the next frame even if nothing changed
+  void requestRedraw();
+  uint32_t getRenderedFrameCount() const;
+  uint32_t getSkippedFrameCount() const;
+  /**
+   * @brief Timing statistics of the last drawn frames, per phase
+   *
+   * Only available when the library is built with M5AVATAR_FRAME_STATS
+   * defined, nullptr otherwise. Skipped frames are not counted.
+   */
+  FrameStats *getFrameStats();
+  /**
+   * @brief Limit the frames per second drawn by the draw task
+   *
+   * The draw task sleeps until a setter changes the avatar, then draws at
+   * most one frame per 1/fps seconds; changes made in between are drawn
+   * together. Defaults to 60.
+   */
+  void setMaxFrameRate(uint16_t fps);
+  uint16_t getMaxFrameRate() const;
   bool isDrawing();
   void start(int colorDepth = 1);
   void stop();
@@ -6,8 +6,12 @@
 #define BALLOON_H_
 #define LGFX_USE_V1
 #include <M5Unified.h>
+#include "Blitter.h"
+#include "DisplayList.h"
 #include "DrawContext.h"
 #include "Drawable.h"
+#include "Fingerprint.h"
+#include "SpeechCanvas.h"
 
 #ifndef ARDUINO
 #include <string>
@@ -20,41 +24,176 @@ const int16_t MIN_WIDTH = 40;
 const int cx = 240;
 const int cy = 220;
 
+// the box of the Wrap and Ticker layouts
+const int BOX_LEFT = 16;
+const int BOX_RIGHT = 304;
+const int BOX_BOTTOM = 236;
+const int BOX_PADDING = 6;
+const int BOX_MAX_TEXT_HEIGHT = 64;
+
 namespace m5avatar {
 class Balloon final : public Drawable {
+ private:
+  // the text rendered once and copied into the canvas every frame
+  SpeechCanvas text_;
+  // the balloon without its text, recorded once per shape and colors and
+  // replayed every frame
+  DisplayList shape_;
+  uint32_t shapeKey_ = 0;
+
+  // size is the text width for Line and the box top for the others
+  void drawShape(lgfx::LovyanGFX *spi, SpeechLayout layout, int size,
+                 uint16_t primaryColor, uint16_t backgroundColor) {
+    if (layout == SpeechLayout::Line) {
+      int textHeight = TEXT_HEIGHT * TEXT_SIZE;
+      spi->fillEllipse(cx - 20, cy, size + 2, textHeight * 2 + 2,
+                       primaryColor);
+      spi->fillTriangle(cx - 62, cy - 42, cx - 8, cy - 10, cx - 41, cy - 8,
+                        primaryColor);
+      spi->fillEllipse(cx - 20, cy, size, textHeight * 2, backgroundColor);
+      spi->fillTriangle(cx - 60, cy - 40, cx - 10, cy - 10, cx - 40, cy - 10,
+                        backgroundColor);
+      return;
+    }
+    int top = size;
+    spi->fillRoundRect(BOX_LEFT, top, BOX_RIGHT - BOX_LEFT, BOX_BOTTOM - top,
+                       8, primaryColor);
+    spi->fillTriangle(cx - 62, top - 16, cx - 50, top + 2, cx - 30, top + 2,
+                      primaryColor);
+    spi->fillRoundRect(BOX_LEFT + 2, top + 2, BOX_RIGHT - BOX_LEFT - 4,
+                       BOX_BOTTOM - top - 4, 6, backgroundColor);
+    spi->fillTriangle(cx - 60, top - 12, cx - 48, top + 3, cx - 33, top + 3,
+                      backgroundColor);
+  }
+
+  // replay the shape, recording it first if it changed
+  void compositeShape(M5Canvas *spi, SpeechLayout layout, int size,
+                      uint16_t primaryColor, uint16_t backgroundColor) {
+    int depth = spi->getColorDepth() & 0xFF;
+    uint32_t key = Fingerprint()
+                       .add(layout)
+                       .add(size)
+                       .add(primaryColor)
+                       .add(backgroundColor)
+                       .add(depth)
+                       .add(spi->width())
+                       .add(spi->height())
+                       .get();
+    if (key != shapeKey_) {
+      RecordingCanvas recorder;
+      recorder.begin(&shape_, spi->width(), spi->height(), depth);
+      drawShape(&recorder, layout, size, primaryColor, backgroundColor);
+      recorder.end();
+      shapeKey_ = key;
+    }
+    shape_.replay(spi);
+  }
+
+  // lines of the box for the layout and font
+  int16_t boxLines(SpeechLayout layout, const lgfx::IFont *font) {
+    if (layout != SpeechLayout::Wrap) {
+      return 1;
+    }
+    int16_t lineHeight = text_.getLineHeight(font, TEXT_SIZE);
+    return std::max(1, BOX_MAX_TEXT_HEIGHT / std::max<int16_t>(1, lineHeight));
+  }
+
+  int16_t boxTop(SpeechLayout layout, const lgfx::IFont *font) {
+    int16_t lineHeight = text_.getLineHeight(font, TEXT_SIZE);
+    return BOX_BOTTOM - boxLines(layout, font) * lineHeight - BOX_PADDING * 2;
+  }
+
+  // canvases without a buffer (a RecordingCanvas) take the text as runs
+  bool copyText(M5Canvas *spi, int32_t x, int32_t y) {
+    M5Canvas *sprite = text_.getSprite();
+    return copyToCanvas(sprite, spi, x, y) || drawAsRuns(sprite, spi, x, y);
+  }
+
+  void drawLine(M5Canvas *spi, const char *text, const lgfx::IFont *font,
+                uint16_t primaryColor, uint16_t backgroundColor) {
+    int textWidth = text_.measure(text, font, TEXT_SIZE);
+    compositeShape(spi, SpeechLayout::Line, textWidth, primaryColor,
+                   backgroundColor);
+    // centered at the same point drawString used with MC_DATUM
+    int x = cx - textWidth / 6 - 15;
+    if (text_.update(text, font, TEXT_SIZE, SpeechLayout::Line, -1, 0, 1,
+                     primaryColor, backgroundColor, spi->getColorDepth())) {
+      // the sprite may be another one after the update
+      M5Canvas *sprite = text_.getSprite();
+      if (copyText(spi, x - sprite->width() / 2, cy - sprite->height() / 2)) {
+        return;
+      }
+    }
+    spi->setTextSize(TEXT_SIZE);
+    spi->setTextColor(primaryColor, backgroundColor);
+    spi->setTextDatum(MC_DATUM);
+    spi->drawString(text, x, cy, font);  // Continue printing from new x position
+  }
+
+  void drawBox(M5Canvas *spi, DrawContext *ctx, uint16_t primaryColor,
+               uint16_t backgroundColor) {
+    SpeechLayout layout = ctx->getSpeechLayout();
+    const lgfx::IFont *font = ctx->getSpeechFont();
+    int top = boxTop(layout, font);
+    compositeShape(spi, layout, top, primaryColor, backgroundColor);
+    if (text_.update(ctx->getSpeechText(), font, TEXT_SIZE, layout,
+                     ctx->getSpeechScroll(),
+                     BOX_RIGHT - BOX_LEFT - BOX_PADDING * 2,
+                     boxLines(layout, font), primaryColor, backgroundColor,
+                     spi->getColorDepth())) {
+      copyText(spi, BOX_LEFT + BOX_PADDING, top + BOX_PADDING);
+    }
+  }
+
  public:
   // constructor
   Balloon() = default;
   ~Balloon() = default;
-  Balloon(const Balloon &other) = default;
-  Balloon &operator=(const Balloon &other) = default;
+  Balloon(const Balloon &other) = delete;
+  Balloon &operator=(const Balloon &other) = delete;
+  // glyphs of the speech text, its budget can be changed
+  GlyphCache *getGlyphCache() { return text_.getGlyphCache(); }
   void draw(M5Canvas *spi, BoundingRect rect,
             DrawContext *drawContext) override {
-    String text = drawContext->getspeechText();
+    const char *text = drawContext->getSpeechText();
     const lgfx::IFont *font = drawContext->getSpeechFont();
-    if (text.length() == 0) {
+    if (text[0] == '\0') {
       return;
     }
-    ColorPalette* cp = drawContext->getColorPalette();
-    uint16_t primaryColor = cp->get(COLOR_BALLOON_FOREGROUND);
-    uint16_t backgroundColor = cp->get(COLOR_BALLOON_BACKGROUND);
-    M5.Lcd.setTextSize(TEXT_SIZE);
-    M5.Lcd.setTextDatum(MC_DATUM);
-    spi->setTextSize(TEXT_SIZE);
-    spi->setTextColor(primaryColor, backgroundColor);
-    spi->setTextDatum(MC_DATUM);
-    M5.Lcd.setFont(font);
-    int textWidth = M5.Lcd.textWidth(text.c_str());
+    uint16_t primaryColor = drawContext->getColor(ColorKey::BalloonForeground);
+    uint16_t backgroundColor =
+        drawContext->getColor(ColorKey::BalloonBackground);
+    if (drawContext->getSpeechLayout() == SpeechLayout::Line) {
+      drawLine(spi, text, font, primaryColor, backgroundColor);
+    } else {
+      drawBox(spi, drawContext, primaryColor, backgroundColor);
+    }
+  }
+
+  bool getRegion(BoundingRect rect, DrawContext *drawContext,
+                 BoundingRect *region) override {
+    const char *text = drawContext->getSpeechText();
+    if (text[0] == '\0') {
+      *region = BoundingRect(0, 0, 0, 0);
+      return true;
+    }
+    SpeechLayout layout = drawContext->getSpeechLayout();
+    if (layout != SpeechLayout::Line) {
+      // the box and the tail above it
+      int top = boxTop(layout, drawContext->getSpeechFont()) - 16;
+      *region = BoundingRect(top, BOX_LEFT, BOX_RIGHT - BOX_LEFT,
+                             BOX_BOTTOM - top);
+      return true;
+    }
+    int textWidth = text_.measure(text, drawContext->getSpeechFont(), TEXT_SIZE);
     int textHeight = TEXT_HEIGHT * TEXT_SIZE;
-    spi->fillEllipse(cx - 20, cy,textWidth + 2, textHeight * 2 + 2,
-                     primaryColor);
-    spi->fillTriangle(cx - 62, cy - 42, cx - 8, cy - 10, cx - 41, cy - 8,
-                      primaryColor);
-    spi->fillEllipse(cx - 20, cy, textWidth, textHeight * 2,
-                     backgroundColor);
-    spi->fillTriangle(cx - 60, cy - 40, cx - 10, cy - 10, cx - 40, cy - 10,
-                      backgroundColor);
-    spi->drawString(text.c_str(), cx - textWidth / 6 - 15, cy, font);  // Continue printing from new x position
+    // the outer ellipse and the tail, the text stays inside the ellipse
+    int left = std::min(cx - 20 - textWidth - 3, cx - 62);
+    int right = std::max(cx - 20 + textWidth + 3, cx - 7);
+    int top = std::min(cy - textHeight * 2 - 3, cy - 42);
+    int bottom = cy + textHeight * 2 + 3;
+    *region = BoundingRect(top, left, right - left, bottom - top);
+    return true;
   }
 };
 
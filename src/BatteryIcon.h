@@ -8,11 +8,28 @@
 #include <M5Unified.h>
 #include "DrawContext.h"
 #include "Drawable.h"
+#include "Fingerprint.h"
 
 namespace m5avatar {
 
+/**
+ * The battery icon, drawn as a part or kept rendered in its own sprite
+ *
+ * Face draws the sprite upright into the strips over the face, so a new
+ * battery level only pushes the strips under the icon. The sprite is
+ * rendered again only when the status, the level, the colors or the color
+ * depth change.
+ */
 class BatteryIcon final : public Drawable {
+ public:
+  static constexpr int16_t kWidth = 36;
+  static constexpr int16_t kHeight = 16;
+
  private:
+  M5Canvas sprite_;
+  // inputs the sprite was rendered with, 0 if it was not
+  uint32_t spriteKey_ = 0;
+
   void drawBatteryIcon(M5Canvas *spi, uint32_t x, uint32_t y, uint16_t fgcolor, uint16_t bgcolor, float offset, BatteryIconStatus batteryIconStatus, int32_t batteryLevel) {
     spi->drawRect(x, y + 5, 5, 5, fgcolor);
     spi->drawRect(x + 5, y, 30, 15, fgcolor);
@@ -32,18 +49,77 @@ class BatteryIcon final : public Drawable {
   // constructor
   BatteryIcon() = default;
   ~BatteryIcon() = default;
-  BatteryIcon(const BatteryIcon &other) = default;
-  BatteryIcon &operator=(const BatteryIcon &other) = default;
+  BatteryIcon(const BatteryIcon &other) = delete;
+  BatteryIcon &operator=(const BatteryIcon &other) = delete;
   void draw(M5Canvas *spi, BoundingRect rect, DrawContext *ctx) override {
     if (ctx->getBatteryIconStatus() != BatteryIconStatus::invisible) {
-      uint16_t primaryColor = ctx->getColorDepth() == 1 ? 1 : ctx->getColorPalette()->get(COLOR_PRIMARY);
-      uint16_t bgColor = ctx->getColorDepth() == 1 ? ERACER_COLOR : ctx->getColorPalette()->get(COLOR_BACKGROUND);
+      uint16_t primaryColor = ctx->getColor(ColorKey::Primary);
+      uint16_t bgColor = ctx->getColor(ColorKey::Background);
       float offset = ctx->getBreath();
       int32_t batteryLevel = ctx->getBatteryLevel();
       drawBatteryIcon(spi, 285, 5, primaryColor, bgColor, -offset, ctx->getBatteryIconStatus(), batteryLevel);
     }
   };
 
+  bool getRegion(BoundingRect rect, DrawContext *ctx,
+                 BoundingRect *region) override {
+    if (ctx->getBatteryIconStatus() == BatteryIconStatus::invisible) {
+      *region = BoundingRect(0, 0, 0, 0);
+    } else {
+      *region = BoundingRect(5, 285, kWidth, kHeight);
+    }
+    return true;
+  }
+
+  /**
+   * @brief Render the icon into the sprite if its inputs changed
+   *
+   * @return true if the sprite was rendered again, false if it is up to
+   * date, the icon is invisible or the sprite could not be allocated
+   */
+  bool update(DrawContext *ctx, int colorDepth) {
+    BatteryIconStatus status = ctx->getBatteryIconStatus();
+    if (status == BatteryIconStatus::invisible) {
+      return false;
+    }
+    ColorPalette *cp = ctx->getColorPalette();
+    uint16_t primaryColor = ctx->getColor(ColorKey::Primary);
+    uint16_t bgColor = ctx->getColor(ColorKey::Background);
+    uint32_t key = Fingerprint()
+                       .add(status)
+                       .add(ctx->getBatteryLevel())
+                       .add(cp->get(ColorKey::Primary))
+                       .add(cp->get(ColorKey::Background))
+                       .add(colorDepth)
+                       .get();
+    if (key == spriteKey_ && sprite_.getBuffer() != nullptr) {
+      return false;
+    }
+    if ((sprite_.getColorDepth() & 0xFF) != colorDepth) {
+      sprite_.deleteSprite();
+      sprite_.setColorDepth(colorDepth);
+    }
+    if (sprite_.getBuffer() == nullptr &&
+        sprite_.createSprite(kWidth, kHeight) == nullptr) {
+      spriteKey_ = 0;
+      return false;
+    }
+    // NOTE: the 1-bit sprite is pushed through its palette
+    sprite_.setBitmapColor(cp->get(ColorKey::Primary),
+                           cp->get(ColorKey::Background));
+    sprite_.fillSprite(bgColor);
+    drawBatteryIcon(&sprite_, 0, 0, primaryColor, bgColor, -ctx->getBreath(),
+                    status, ctx->getBatteryLevel());
+    spriteKey_ = key;
+    return true;
+  }
+
+  // nullptr until update() renders it
+  M5Canvas *getSprite() {
+    return sprite_.getBuffer() != nullptr && spriteKey_ != 0 ? &sprite_
+                                                             : nullptr;
+  }
+
 };
 
 }  // namespace m5avatar
@@ -0,0 +1,387 @@
+// Copyright (c) Shinya Ishikawa. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full
+// license information.
+
+#include "Blitter.h"
+
+namespace m5avatar {
+namespace {
+
+// the lower byte of lgfx::color_depth_t is the number of bits per pixel
+inline int bitsOf(lgfx::color_depth_t depth) { return depth & 0xFF; }
+
+// bytes per row of a sprite buffer, palette sprites pad rows to a whole byte
+inline int32_t strideOf(int32_t width, int bits) {
+  return bits < 8 ? (width * bits + 7) >> 3 : width * (bits >> 3);
+}
+
+inline uint16_t rgb332to565(uint8_t c) {
+  uint16_t r = c >> 5, g = (c >> 2) & 0x07, b = c & 0x03;
+  return ((r << 2 | r >> 1) << 11) | ((g << 3 | g) << 5) |
+         (b << 3 | b << 1 | b >> 1);
+}
+
+// 16-bit strips hold big-endian RGB565 (lgfx::swap565_t)
+struct Swap565 {
+  static constexpr int kBytes = 2;
+  static void store(uint8_t *dst, uint16_t rgb565) {
+    dst[0] = rgb565 >> 8;
+    dst[1] = rgb565;
+  }
+};
+
+// 24-bit strips hold R, G, B bytes in this order (lgfx::bgr888_t)
+struct Bgr888 {
+  static constexpr int kBytes = 3;
+  static void store(uint8_t *dst, uint16_t rgb565) {
+    uint8_t r = rgb565 >> 11, g = (rgb565 >> 5) & 0x3F, b = rgb565 & 0x1F;
+    dst[0] = r << 3 | r >> 2;
+    dst[1] = g << 2 | g >> 4;
+    dst[2] = b << 3 | b >> 2;
+  }
+};
+
+template <typename Dst>
+void copyRows1(const uint8_t *src, int32_t srcStride, int16_t x, int16_t w,
+               int16_t h, uint8_t *dst, int32_t dstStride, uint16_t fgColor,
+               uint16_t bgColor) {
+  uint8_t colors[2][Dst::kBytes];
+  Dst::store(colors[0], bgColor);
+  Dst::store(colors[1], fgColor);
+  for (int16_t row = 0; row < h; row++) {
+    const uint8_t *s = src + row * srcStride;
+    uint8_t *d = dst + row * dstStride;
+    for (int32_t i = x; i < x + w; i++) {
+      const uint8_t *c = colors[(s[i >> 3] >> (7 - (i & 7))) & 1];
+      for (int k = 0; k < Dst::kBytes; k++) {
+        *d++ = c[k];
+      }
+    }
+  }
+}
+
+template <typename Dst>
+void copyRows8(const uint8_t *src, int32_t srcStride, int16_t x, int16_t w,
+               int16_t h, uint8_t *dst, int32_t dstStride) {
+  for (int16_t row = 0; row < h; row++) {
+    const uint8_t *s = src + row * srcStride + x;
+    uint8_t *d = dst + row * dstStride;
+    for (int16_t i = 0; i < w; i++, d += Dst::kBytes) {
+      Dst::store(d, rgb332to565(s[i]));
+    }
+  }
+}
+
+template <typename Dst>
+void copyRows16(const uint8_t *src, int32_t srcStride, int16_t x, int16_t w,
+                int16_t h, uint8_t *dst, int32_t dstStride) {
+  for (int16_t row = 0; row < h; row++) {
+    const uint8_t *s = src + row * srcStride + x * 2;
+    uint8_t *d = dst + row * dstStride;
+    if (Dst::kBytes == 2) {
+      // both sides are big-endian RGB565
+      memcpy(d, s, w * 2);
+      continue;
+    }
+    for (int16_t i = 0; i < w; i++, s += 2, d += Dst::kBytes) {
+      Dst::store(d, s[0] << 8 | s[1]);
+    }
+  }
+}
+
+template <typename Dst>
+bool copyRows(int srcBits, const uint8_t *src, int32_t srcStride, int16_t x,
+              int16_t w, int16_t h, uint8_t *dst, int32_t dstStride,
+              uint16_t fgColor, uint16_t bgColor) {
+  switch (srcBits) {
+    case 1:
+      copyRows1<Dst>(src, srcStride, x, w, h, dst, dstStride, fgColor,
+                     bgColor);
+      return true;
+    case 8:
+      copyRows8<Dst>(src, srcStride, x, w, h, dst, dstStride);
+      return true;
+    case 16:
+      copyRows16<Dst>(src, srcStride, x, w, h, dst, dstStride);
+      return true;
+    default:
+      return false;
+  }
+}
+
+// fill w x h pixels from column x of the rows with the color
+template <typename Dst>
+void fillRows(uint8_t *dst, int32_t dstStride, int32_t x, int32_t w, int32_t h,
+              uint16_t rgb565) {
+  uint8_t color[Dst::kBytes];
+  Dst::store(color, rgb565);
+  for (int32_t row = 0; row < h; row++) {
+    uint8_t *d = dst + row * dstStride + x * Dst::kBytes;
+    for (int32_t i = 0; i < w; i++) {
+      for (int k = 0; k < Dst::kBytes; k++) {
+        *d++ = color[k];
+      }
+    }
+  }
+}
+
+// copy the part of the strip the canvas covers, fill the rest with bgColor
+template <typename Dst>
+bool copyOrFill(int srcBits, const uint8_t *src, int32_t srcStride,
+                int32_t srcW, int32_t srcH, int32_t x, int32_t y, int32_t w,
+                int32_t h, uint8_t *dst, int32_t dstStride, uint16_t fgColor,
+                uint16_t bgColor) {
+  if (srcBits != 1 && srcBits != 8 && srcBits != 16) {
+    return false;
+  }
+  int32_t left = std::max<int32_t>(x, 0);
+  int32_t top = std::max<int32_t>(y, 0);
+  int32_t right = std::min<int32_t>(x + w, srcW);
+  int32_t bottom = std::min<int32_t>(y + h, srcH);
+  if (left >= right || top >= bottom) {
+    fillRows<Dst>(dst, dstStride, 0, w, h, bgColor);
+    return true;
+  }
+  // strip rows above and below the canvas, columns left and right of it
+  fillRows<Dst>(dst, dstStride, 0, w, top - y, bgColor);
+  fillRows<Dst>(dst + (bottom - y) * dstStride, dstStride, 0, w,
+                y + h - bottom, bgColor);
+  uint8_t *rows = dst + (top - y) * dstStride;
+  fillRows<Dst>(rows, dstStride, 0, left - x, bottom - top, bgColor);
+  fillRows<Dst>(rows, dstStride, right - x, x + w - right, bottom - top,
+                bgColor);
+  return copyRows<Dst>(srcBits, src + top * srcStride, srcStride, left,
+                       right - left, bottom - top,
+                       rows + (left - x) * Dst::kBytes, dstStride, fgColor,
+                       bgColor);
+}
+
+// source readers for the affine resampler, returning RGB565
+struct Src1 {
+  static uint16_t read(const uint8_t *row, int32_t x, const uint16_t *palette) {
+    return palette[(row[x >> 3] >> (~x & 7)) & 1];
+  }
+};
+
+struct Src8 {
+  static uint16_t read(const uint8_t *row, int32_t x, const uint16_t *) {
+    return rgb332to565(row[x]);
+  }
+};
+
+struct Src16 {
+  static uint16_t read(const uint8_t *row, int32_t x, const uint16_t *) {
+    return row[x * 2] << 8 | row[x * 2 + 1];
+  }
+};
+
+// affine mapping from strip pixels to canvas pixels in 16.16 fixed point
+struct Affine {
+  // canvas position of the center of the strip's top-left pixel
+  float u0, v0;
+  // canvas steps for one strip pixel to the right and one down
+  int32_t dudx, dvdx, dudy, dvdy;
+};
+
+template <typename Src, typename Dst>
+void affineRows(const uint8_t *src, int32_t srcStride, int32_t srcW,
+                int32_t srcH, uint8_t *dst, int32_t dstStride, int32_t dstW,
+                int32_t dstH, const Affine &m, const uint16_t *palette) {
+  uint8_t background[Dst::kBytes];
+  Dst::store(background, palette[0]);
+  int32_t u = static_cast<int32_t>(m.u0 * 65536.0f);
+  int32_t v = static_cast<int32_t>(m.v0 * 65536.0f);
+  for (int32_t row = 0; row < dstH; row++, u += m.dudy, v += m.dvdy) {
+    uint8_t *d = dst + row * dstStride;
+    int32_t su = u, sv = v;
+    for (int32_t i = 0; i < dstW; i++, su += m.dudx, sv += m.dvdx,
+                 d += Dst::kBytes) {
+      // negative coordinates wrap to large unsigned values
+      uint32_t x = su >> 16, y = sv >> 16;
+      if (x < static_cast<uint32_t>(srcW) && y < static_cast<uint32_t>(srcH)) {
+        Dst::store(d, Src::read(src + y * srcStride, x, palette));
+      } else {
+        for (int k = 0; k < Dst::kBytes; k++) {
+          d[k] = background[k];
+        }
+      }
+    }
+  }
+}
+
+template <typename Dst>
+bool affine(int srcBits, const uint8_t *src, int32_t srcStride, int32_t srcW,
+            int32_t srcH, uint8_t *dst, int32_t dstStride, int32_t dstW,
+            int32_t dstH, const Affine &m, const uint16_t *palette) {
+  switch (srcBits) {
+    case 1:
+      affineRows<Src1, Dst>(src, srcStride, srcW, srcH, dst, dstStride, dstW,
+                            dstH, m, palette);
+      return true;
+    case 8:
+      affineRows<Src8, Dst>(src, srcStride, srcW, srcH, dst, dstStride, dstW,
+                            dstH, m, palette);
+      return true;
+    case 16:
+      affineRows<Src16, Dst>(src, srcStride, srcW, srcH, dst, dstStride, dstW,
+                             dstH, m, palette);
+      return true;
+    default:
+      return false;
+  }
+}
+
+}  // namespace
+
+bool copyToStrip(M5Canvas *canvas, int16_t x, int16_t y, int16_t w, int16_t h,
+                 M5Canvas *strip, uint16_t fgColor, uint16_t bgColor) {
+  const uint8_t *src = static_cast<const uint8_t *>(canvas->getBuffer());
+  uint8_t *dst = static_cast<uint8_t *>(strip->getBuffer());
+  if (src == nullptr || dst == nullptr) {
+    return false;
+  }
+  w = std::min<int32_t>(w, strip->width());
+  h = std::min<int32_t>(h, strip->height());
+  if (w <= 0 || h <= 0) {
+    return true;
+  }
+
+  int srcBits = bitsOf(canvas->getColorDepth());
+  int dstBits = bitsOf(strip->getColorDepth());
+  int32_t srcStride = strideOf(canvas->width(), srcBits);
+  int32_t dstStride = strideOf(strip->width(), dstBits);
+  switch (dstBits) {
+    case 16:
+      return copyOrFill<Swap565>(srcBits, src, srcStride, canvas->width(),
+                                 canvas->height(), x, y, w, h, dst, dstStride,
+                                 fgColor, bgColor);
+    case 24:
+      return copyOrFill<Bgr888>(srcBits, src, srcStride, canvas->width(),
+                                canvas->height(), x, y, w, h, dst, dstStride,
+                                fgColor, bgColor);
+    default:
+      return false;
+  }
+}
+
+bool affineToStrip(M5Canvas *canvas, float dstX, float dstY, float angle,
+                   float zoom, int16_t w, M5Canvas *strip, uint16_t fgColor,
+                   uint16_t bgColor) {
+  const uint8_t *src = static_cast<const uint8_t *>(canvas->getBuffer());
+  uint8_t *dst = static_cast<uint8_t *>(strip->getBuffer());
+  if (src == nullptr || dst == nullptr || zoom <= 0.0f) {
+    return false;
+  }
+  // inverse of the clockwise rotation and zoom around the canvas center
+  float rad = angle * 3.14159265f / 180.0f;
+  float cosr = cosf(rad) / zoom;
+  float sinr = sinf(rad) / zoom;
+  float fx = 0.5f - dstX;
+  float fy = 0.5f - dstY;
+  Affine m;
+  m.u0 = canvas->width() / 2.0f + cosr * fx + sinr * fy;
+  m.v0 = canvas->height() / 2.0f - sinr * fx + cosr * fy;
+  m.dudx = static_cast<int32_t>(cosr * 65536.0f);
+  m.dvdx = static_cast<int32_t>(-sinr * 65536.0f);
+  m.dudy = static_cast<int32_t>(sinr * 65536.0f);
+  m.dvdy = static_cast<int32_t>(cosr * 65536.0f);
+  // the outside of the canvas is filled with palette[0]
+  const uint16_t palette[2] = {bgColor, fgColor};
+
+  int srcBits = bitsOf(canvas->getColorDepth());
+  int dstBits = bitsOf(strip->getColorDepth());
+  int32_t srcStride = strideOf(canvas->width(), srcBits);
+  int32_t dstStride = strideOf(strip->width(), dstBits);
+  int32_t dstW = std::max<int32_t>(0, std::min<int32_t>(w, strip->width()));
+  switch (dstBits) {
+    case 16:
+      return affine<Swap565>(srcBits, src, srcStride, canvas->width(),
+                             canvas->height(), dst, dstStride, dstW,
+                             strip->height(), m, palette);
+    case 24:
+      return affine<Bgr888>(srcBits, src, srcStride, canvas->width(),
+                            canvas->height(), dst, dstStride, dstW,
+                            strip->height(), m, palette);
+    default:
+      return false;
+  }
+}
+
+bool copyToCanvas(M5Canvas *sprite, M5Canvas *canvas, int32_t x, int32_t y) {
+  const uint8_t *src = static_cast<const uint8_t *>(sprite->getBuffer());
+  uint8_t *dst = static_cast<uint8_t *>(canvas->getBuffer());
+  int bits = bitsOf(sprite->getColorDepth());
+  if (src == nullptr || dst == nullptr ||
+      bits != bitsOf(canvas->getColorDepth())) {
+    return false;
+  }
+  int32_t clipX, clipY, clipW, clipH;
+  canvas->getClipRect(&clipX, &clipY, &clipW, &clipH);
+  int32_t left = std::max(x, clipX);
+  int32_t top = std::max(y, clipY);
+  int32_t right = std::min(x + sprite->width(), clipX + clipW);
+  int32_t bottom = std::min(y + sprite->height(), clipY + clipH);
+  if (left >= right || top >= bottom) {
+    return true;
+  }
+
+  int32_t srcStride = strideOf(sprite->width(), bits);
+  int32_t dstStride = strideOf(canvas->width(), bits);
+  for (int32_t row = top; row < bottom; row++) {
+    const uint8_t *s = src + (row - y) * srcStride;
+    uint8_t *d = dst + row * dstStride;
+    if (bits >= 8) {
+      int bytes = bits >> 3;
+      memcpy(d + left * bytes, s + (left - x) * bytes, (right - left) * bytes);
+      continue;
+    }
+    // palette sprites pack pixels from the most significant bit
+    uint8_t mask = (1 << bits) - 1;
+    for (int32_t i = left; i < right; i++) {
+      int32_t sb = (i - x) * bits, db = i * bits;
+      uint8_t value = (s[sb >> 3] >> (8 - bits - (sb & 7))) & mask;
+      int shift = 8 - bits - (db & 7);
+      d[db >> 3] = (d[db >> 3] & ~(mask << shift)) | value << shift;
+    }
+  }
+  return true;
+}
+
+bool drawAsRuns(M5Canvas *sprite, lgfx::LovyanGFX *canvas, int32_t x,
+                int32_t y) {
+  const uint8_t *src = static_cast<const uint8_t *>(sprite->getBuffer());
+  int bits = bitsOf(sprite->getColorDepth());
+  if (src == nullptr || bits != bitsOf(canvas->getColorDepth())) {
+    return false;
+  }
+  int32_t stride = strideOf(sprite->width(), bits);
+  auto pixelAt = [&](const uint8_t *row, int32_t i) -> uint32_t {
+    if (bits < 8) {
+      int32_t b = i * bits;
+      return (row[b >> 3] >> (8 - bits - (b & 7))) & ((1 << bits) - 1);
+    }
+    // raw values are kept in memory order, as setRawColor takes them
+    uint32_t value = 0;
+    memcpy(&value, row + i * (bits >> 3), bits >> 3);
+    return value;
+  };
+  canvas->startWrite();
+  for (int32_t row = 0; row < sprite->height(); row++) {
+    const uint8_t *s = src + row * stride;
+    int32_t start = 0;
+    uint32_t value = pixelAt(s, 0);
+    for (int32_t i = 1; i <= sprite->width(); i++) {
+      uint32_t next = i < sprite->width() ? pixelAt(s, i) : ~value;
+      if (next != value) {
+        canvas->setRawColor(value);
+        canvas->fillRect(x + start, y + row, i - start, 1);
+        start = i;
+        value = next;
+      }
+    }
+  }
+  canvas->endWrite();
+  return true;
+}
+
+}  // namespace m5avatar
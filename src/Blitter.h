@@ -0,0 +1,74 @@
+// Copyright (c) Shinya Ishikawa. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full
+// license information.
+
+#ifndef BLITTER_H_
+#define BLITTER_H_
+#define LGFX_USE_V1
+#include <M5GFX.h>
+
+namespace m5avatar {
+/**
+ * @brief Copy a rect of the canvas to the top-left corner of the strip
+ *
+ * Rows are converted straight into the strip's pixel format without the
+ * affine resampling of pushRotateZoom, so this is only valid when the face
+ * is neither rotated nor scaled. The rect may reach outside of the canvas
+ * (x and y may be negative): the pixels of the w x h strip area the canvas
+ * does not cover are filled with bgColor, so the strip need not be cleared.
+ *
+ * Supported sources are 1-bit (expanded with fgColor and bgColor), 8-bit
+ * and 16-bit canvases; supported destinations are 16-bit and 24-bit strips.
+ *
+ * @return false if the combination of color depths is not supported
+ */
+bool copyToStrip(M5Canvas *canvas, int16_t x, int16_t y, int16_t w, int16_t h,
+                 M5Canvas *strip, uint16_t fgColor, uint16_t bgColor);
+
+/**
+ * @brief Resample the canvas rotated and scaled around its center into the
+ * strip
+ *
+ * Same mapping as canvas->pushRotateZoom(strip, dstX, dstY, angle, zoom,
+ * zoom), with nearest-neighbour sampling stepped in 16.16 fixed point and
+ * specialized for each pair of color depths. Strip pixels falling outside of
+ * the canvas are filled with bgColor, so the strip need not be cleared.
+ * Only the first w columns of the strip are written.
+ *
+ * Supported sources and destinations are the same as copyToStrip.
+ *
+ * @param dstX strip position of the canvas center
+ * @param dstY strip position of the canvas center
+ * @param angle clockwise rotation in degrees
+ * @return false if the combination of color depths is not supported
+ */
+bool affineToStrip(M5Canvas *canvas, float dstX, float dstY, float angle,
+                   float zoom, int16_t w, M5Canvas *strip, uint16_t fgColor,
+                   uint16_t bgColor);
+
+/**
+ * @brief Copy the whole sprite into the canvas at (x, y) as raw pixels
+ *
+ * Both must have the same color depth. Pixel values, palette indices
+ * included, are copied unchanged, so this is exact where pushSprite would
+ * convert colors. The copy is clipped to the canvas's clip rect.
+ *
+ * @return false if the color depths differ or a buffer is missing
+ */
+bool copyToCanvas(M5Canvas *sprite, M5Canvas *canvas, int32_t x, int32_t y);
+
+/**
+ * @brief Draw the whole sprite into the canvas at (x, y) as runs of raw
+ * colors through the drawing API
+ *
+ * Slower than copyToCanvas, but works with canvases without a buffer of
+ * their own, such as RecordingCanvas. Both must have the same color depth.
+ *
+ * @return false if the color depths differ or the sprite has no buffer
+ */
+bool drawAsRuns(M5Canvas *sprite, lgfx::LovyanGFX *canvas, int32_t x,
+                int32_t y);
+
+}  // namespace m5avatar
+
+#endif  // BLITTER_H_
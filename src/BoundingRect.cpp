@@ -4,6 +4,8 @@
 
 #include "BoundingRect.h"
 
+#include <algorithm>
+
 namespace m5avatar {
 BoundingRect::BoundingRect(int16_t top, int16_t left)
     : BoundingRect(top, left, 0, 0) {}
@@ -37,4 +39,39 @@ void BoundingRect::setSize(int16_t width, int16_t height) {
   this->width = width;
   this->height = height;
 }
+
+bool BoundingRect::isEmpty() const { return width <= 0 || height <= 0; }
+
+bool BoundingRect::intersects(const BoundingRect &other) const {
+  if (isEmpty() || other.isEmpty()) {
+    return false;
+  }
+  return left < other.left + other.width && other.left < left + width &&
+         top < other.top + other.height && other.top < top + height;
+}
+
+void BoundingRect::unite(const BoundingRect &other) {
+  if (other.isEmpty()) {
+    return;
+  }
+  if (isEmpty()) {
+    *this = other;
+    return;
+  }
+  int16_t right = std::max(left + width, other.left + other.width);
+  int16_t bottom = std::max(top + height, other.top + other.height);
+  left = std::min(left, other.left);
+  top = std::min(top, other.top);
+  width = right - left;
+  height = bottom - top;
+}
+
+bool BoundingRect::operator==(const BoundingRect &other) const {
+  return top == other.top && left == other.left && width == other.width &&
+         height == other.height && rotation_ == other.rotation_;
+}
+
+bool BoundingRect::operator!=(const BoundingRect &other) const {
+  return !(*this == other);
+}
 }  // namespace m5avatar
@@ -37,6 +37,13 @@ class BoundingRect {
   int16_t getHeight();
   void setPosition(int16_t top, int16_t left);
   void setSize(int16_t width, int16_t height);
+
+  bool isEmpty() const;
+  bool intersects(const BoundingRect &other) const;
+  // grow this rect to cover other as well (empty rects are ignored)
+  void unite(const BoundingRect &other);
+  bool operator==(const BoundingRect &other) const;
+  bool operator!=(const BoundingRect &other) const;
 };
 }  // namespace m5avatar
 
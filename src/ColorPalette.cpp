@@ -4,18 +4,44 @@
 
 #include "ColorPalette.h"
 
+#include <string.h>
+
 namespace m5avatar {
+namespace {
+// string keys in the order of ColorKey
+const char *const kColorNames[ColorPalette::kColorCount] = {
+    COLOR_PRIMARY, COLOR_SECONDARY, COLOR_BACKGROUND, COLOR_BALLOON_FOREGROUND,
+    COLOR_BALLOON_BACKGROUND};
+
+// the index of the string key, -1 if there is no such color
+int indexOf(const char *key) {
+  for (int i = 0; i < ColorPalette::kColorCount; i++) {
+    if (strcmp(key, kColorNames[i]) == 0) {
+      return i;
+    }
+  }
+  return -1;
+}
+}  // namespace
+
 ColorPalette::ColorPalette()
-    : colors{{COLOR_PRIMARY, TFT_WHITE},
-             {COLOR_SECONDARY, TFT_BLACK},
-             {COLOR_BACKGROUND, TFT_BLACK},
-             {COLOR_BALLOON_FOREGROUND, TFT_BLACK},
-             {COLOR_BALLOON_BACKGROUND, TFT_WHITE}} {}
+    : colors_{TFT_WHITE, TFT_BLACK, TFT_BLACK, TFT_BLACK, TFT_WHITE},
+      resolved_{},
+      resolvedDepth_{0} {}
+
+uint16_t ColorPalette::get(ColorKey key) const {
+  return colors_[static_cast<int>(key)];
+}
+
+void ColorPalette::set(ColorKey key, uint16_t value) {
+  colors_[static_cast<int>(key)] = value;
+  resolvedDepth_ = 0;
+}
 
 uint16_t ColorPalette::get(const char* key) const {
-  auto itr = colors.find(key);
-  if (itr != colors.end()) {
-    return itr->second;
+  int index = indexOf(key);
+  if (index >= 0) {
+    return colors_[index];
   } else {
     // NOTE: if no value it returns BLACK(0x00) as the default value of the
     // type(int)
@@ -25,10 +51,33 @@ uint16_t ColorPalette::get(const char* key) const {
 }
 
 void ColorPalette::set(const char* key, uint16_t value) {
-  auto itr = colors.find(key);
-  if (itr != colors.end()) {
-    M5_LOGI("Overwriting");
+  int index = indexOf(key);
+  if (index < 0) {
+    M5_LOGI("no color with the key %s", key);
+    return;
+  }
+  set(static_cast<ColorKey>(index), value);
+}
+
+void ColorPalette::clear(void) {
+  for (int i = 0; i < kColorCount; i++) {
+    colors_[i] = TFT_BLACK;
+  }
+  resolvedDepth_ = 0;
+}
+
+void ColorPalette::resolve(int colorDepth) {
+  if (colorDepth == resolvedDepth_) {
+    return;
+  }
+  for (int i = 0; i < kColorCount; i++) {
+    resolved_[i] = colors_[i];
+  }
+  if (colorDepth == 1) {
+    resolved_[static_cast<int>(ColorKey::Primary)] = 1;
+    resolved_[static_cast<int>(ColorKey::Secondary)] = 1;
+    resolved_[static_cast<int>(ColorKey::Background)] = 0;
   }
-  itr->second = value;
+  resolvedDepth_ = colorDepth;
 }
 }  // namespace m5avatar
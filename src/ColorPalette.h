@@ -5,8 +5,6 @@
 #ifndef COLORPALETTE_H_
 #define COLORPALETTE_H_
 #include <M5Unified.h>
-#include <string>
-#include <map>
 #define COLOR_PRIMARY "primary"
 #define COLOR_SECONDARY "secondary"
 #define COLOR_BACKGROUND "background"
@@ -14,20 +12,29 @@
 #define COLOR_BALLOON_BACKGROUND "balloon_b"
 
 namespace m5avatar {
-// enum class ColorType
-// {
-//   ONEBYTE,
-//   TWOBYTE,
-//   ONEBIT
-// }
+/**
+ * Colors of the palette, COLOR_* are the string keys of the same colors
+ */
+enum class ColorKey : uint8_t {
+  Primary,
+  Secondary,
+  Background,
+  BalloonForeground,
+  BalloonBackground
+};
+
 /**
  * Color palette for drawing face
  */
 class ColorPalette {
+ public:
+  static constexpr int kColorCount = 5;
+
  private:
-  // ColorType colorType;
-  // uint16_t colors[2];
-  std::map<std::string, uint16_t> colors;
+  uint16_t colors_[kColorCount];
+  // colors for the canvas depth the palette was last resolved for
+  uint16_t resolved_[kColorCount];
+  int resolvedDepth_;
 
  public:
   // TODO(meganetaaan): constructor with color settings
@@ -36,9 +43,25 @@ class ColorPalette {
   ColorPalette(const ColorPalette &other) = default;
   ColorPalette &operator=(const ColorPalette &other) = default;
 
+  uint16_t get(ColorKey key) const;
+  void set(ColorKey key, uint16_t value);
   uint16_t get(const char *key) const;
   void set(const char *key, uint16_t value);
   void clear(void);
+
+  /**
+   * @brief Compute the colors parts draw with on a canvas of the depth
+   *
+   * On a 1-bit canvas the face colors are palette indices: primary and
+   * secondary draw with 1 and background with 0, the canvas palette maps
+   * them to the real colors. Does nothing if the palette is already
+   * resolved for the depth.
+   */
+  void resolve(int colorDepth);
+  // the color resolved for the canvas, resolve() must be called first
+  uint16_t getResolved(ColorKey key) const {
+    return resolved_[static_cast<int>(key)];
+  }
 };
 }  // namespace m5avatar
 
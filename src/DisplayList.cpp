@@ -0,0 +1,263 @@
+// Copyright (c) Shinya Ishikawa. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full
+// license information.
+
+#include "DisplayList.h"
+
+#include <string.h>
+
+#include "Fingerprint.h"
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+namespace m5avatar {
+
+DisplayList::DisplayList()
+    : bounds_{0, 0, 0, 0}, hash_{0}, hashed_{false} {}
+
+void DisplayList::clear() {
+  commands_.clear();
+  bounds_ = BoundingRect(0, 0, 0, 0);
+  hashed_ = false;
+}
+
+void DisplayList::add(int16_t x, int16_t y, int16_t w, int16_t h,
+                      uint32_t color) {
+  if (w <= 0 || h <= 0) {
+    return;
+  }
+  hashed_ = false;
+  bounds_.unite(BoundingRect(y, x, w, h));
+  if (!commands_.empty()) {
+    Command &last = commands_.back();
+    if (last.x == x && last.w == w && last.color == color &&
+        last.y + last.h == y) {
+      last.h += h;
+      return;
+    }
+  }
+  commands_.push_back({x, y, w, h, color});
+}
+
+size_t DisplayList::size() const { return commands_.size(); }
+
+const DisplayList::Command *DisplayList::begin() const {
+  return commands_.data();
+}
+
+const DisplayList::Command *DisplayList::end() const {
+  return commands_.data() + commands_.size();
+}
+
+BoundingRect DisplayList::getBounds() const { return bounds_; }
+
+uint32_t DisplayList::getHash() {
+  if (!hashed_) {
+    Fingerprint fp;
+    for (const Command &command : commands_) {
+      fp.add(command.x)
+          .add(command.y)
+          .add(command.w)
+          .add(command.h)
+          .add(command.color);
+    }
+    hash_ = fp.add(commands_.size()).get();
+    hashed_ = true;
+  }
+  return hash_;
+}
+
+bool DisplayList::operator==(const DisplayList &other) const {
+  if (commands_.size() != other.commands_.size()) {
+    return false;
+  }
+  for (size_t i = 0; i < commands_.size(); i++) {
+    const Command &a = commands_[i];
+    const Command &b = other.commands_[i];
+    if (a.x != b.x || a.y != b.y || a.w != b.w || a.h != b.h ||
+        a.color != b.color) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool DisplayList::operator!=(const DisplayList &other) const {
+  return !(*this == other);
+}
+
+void DisplayList::replay(lgfx::LovyanGFX *target, int32_t dx,
+                         int32_t dy) const {
+  int32_t clipX, clipY, clipW, clipH;
+  target->getClipRect(&clipX, &clipY, &clipW, &clipH);
+  target->startWrite();
+  for (const Command &command : commands_) {
+    int32_t x = command.x + dx;
+    int32_t y = command.y + dy;
+    // skip what the target clips away without converting its color
+    if (x >= clipX + clipW || x + command.w <= clipX ||
+        y >= clipY + clipH || y + command.h <= clipY) {
+      continue;
+    }
+    target->setRawColor(command.color);
+    target->fillRect(x, y, command.w, command.h);
+  }
+  target->endWrite();
+}
+
+void RecordingCanvas::RecordingPanel::setSize(int16_t width, int16_t height) {
+  _width = width;
+  _height = height;
+}
+
+void RecordingCanvas::RecordingPanel::drawPixelPreclipped(uint_fast16_t x,
+                                                          uint_fast16_t y,
+                                                          uint32_t rawcolor) {
+  if (list != nullptr) {
+    list->add(x, y, 1, 1, rawcolor);
+  }
+}
+
+void RecordingCanvas::RecordingPanel::writeFillRectPreclipped(
+    uint_fast16_t x, uint_fast16_t y, uint_fast16_t w, uint_fast16_t h,
+    uint32_t rawcolor) {
+  if (list != nullptr) {
+    list->add(x, y, w, h, rawcolor);
+  }
+}
+
+RecordingCanvas::RecordingCanvas() {
+  // everything drawn goes to the recording panel instead of the buffer
+  _panel = &panel_;
+}
+
+void RecordingCanvas::begin(DisplayList *list, int16_t width, int16_t height,
+                            int colorDepth) {
+  if ((getColorDepth() & 0xFF) != colorDepth) {
+    // converts the colors to raw values of this depth
+    setColorDepth(colorDepth);
+    _panel = &panel_;
+  }
+  panel_.setSize(width, height);
+  clearClipRect();
+  list->clear();
+  panel_.list = list;
+}
+
+void RecordingCanvas::end() { panel_.list = nullptr; }
+
+// narrow [first, last) to the i with lo <= t0 + dt * i < hi, false if none
+// are left; an edge shared by two commands splits the pixels between them
+static bool sampleSpan(float t0, float dt, float lo, float hi,
+                       int32_t *first, int32_t *last) {
+  float from = *first, to = *last;
+  if (dt > 0.0f) {
+    from = ceilf((lo - t0) / dt);
+    to = ceilf((hi - t0) / dt);
+  } else if (dt < 0.0f) {
+    from = floorf((hi - t0) / dt) + 1.0f;
+    to = floorf((lo - t0) / dt) + 1.0f;
+  } else if (t0 < lo || t0 >= hi) {
+    return false;
+  }
+  // compared as floats, dt close to 0 puts the edges far out of range
+  if (from > *first) {
+    *first = static_cast<int32_t>(std::min<float>(from, *last));
+  }
+  if (to < *last) {
+    *last = static_cast<int32_t>(std::max<float>(to, *first));
+  }
+  return *first < *last;
+}
+
+DisplayListRenderer::DisplayListRenderer()
+    : lists_{}, count_{0}, width_{0}, height_{0} {}
+
+void DisplayListRenderer::reset(int16_t width, int16_t height) {
+  count_ = 0;
+  width_ = width;
+  height_ = height;
+}
+
+bool DisplayListRenderer::add(const DisplayList *list) {
+  if (count_ >= kMaxLists) {
+    return false;
+  }
+  lists_[count_++] = list;
+  return true;
+}
+
+void DisplayListRenderer::replayAll(lgfx::LovyanGFX *target, int32_t dx,
+                                    int32_t dy) const {
+  for (int i = 0; i < count_; i++) {
+    lists_[i]->replay(target, dx, dy);
+  }
+}
+
+void DisplayListRenderer::render(M5Canvas *strip, const StripSource &source,
+                                 int16_t x, int16_t y, int16_t w) const {
+  int16_t h = strip->height();
+  if (source.rotation == 0.0f && source.scale == 1.0f) {
+    // strip position of the top-left corner of the face
+    int32_t left = lroundf(source.centerX - width_ / 2.0f) - x;
+    int32_t top = lroundf(source.centerY - height_ / 2.0f) - y;
+    strip->clearClipRect();
+    strip->fillRect(0, 0, w, h, source.bgColor);
+    strip->setClipRect(left, top, width_, height_);
+    replayAll(strip, left, top);
+    strip->clearClipRect();
+    return;
+  }
+
+  // the face rows the strip samples, from its corners mapped back, to skip
+  // strips beside the face
+  float rad = source.rotation * M_PI / 180.0f;
+  float cosr = cosf(rad) / source.scale;
+  float sinr = sinf(rad) / source.scale;
+  float minV = 0.0f, maxV = 0.0f;
+  for (int corner = 0; corner < 4; corner++) {
+    float px = x + (corner & 1 ? w : 0) - source.centerX;
+    float py = y + (corner & 2 ? h : 0) - source.centerY;
+    float v = -sinr * px + cosr * py + height_ / 2.0f;
+    minV = corner == 0 ? v : std::min(minV, v);
+    maxV = corner == 0 ? v : std::max(maxV, v);
+  }
+  strip->clearClipRect();
+  strip->fillRect(0, 0, w, h, source.bgColor);
+  if (maxV < 0.0f || minV >= height_) {
+    return;
+  }
+
+  // every strip row maps back to a line through the face: each command
+  // fills the pixels whose centers land in it, later commands on top
+  strip->startWrite();
+  for (int16_t row = 0; row < h; row++) {
+    float px = x + 0.5f - source.centerX;
+    float py = y + row + 0.5f - source.centerY;
+    float u0 = cosr * px + sinr * py + width_ / 2.0f;
+    float v0 = -sinr * px + cosr * py + height_ / 2.0f;
+    float rowMinV = std::min(v0, v0 - sinr * (w - 1));
+    float rowMaxV = std::max(v0, v0 - sinr * (w - 1));
+    for (int i = 0; i < count_; i++) {
+      for (const DisplayList::Command &command : *lists_[i]) {
+        if (command.y + command.h <= rowMinV || command.y > rowMaxV) {
+          continue;
+        }
+        int32_t first = 0, last = w;
+        if (!sampleSpan(u0, cosr, command.x, command.x + command.w, &first,
+                        &last) ||
+            !sampleSpan(v0, -sinr, command.y, command.y + command.h, &first,
+                        &last)) {
+          continue;
+        }
+        strip->setRawColor(command.color);
+        strip->fillRect(first, row, last - first, 1);
+      }
+    }
+  }
+  strip->endWrite();
+}
+
+}  // namespace m5avatar
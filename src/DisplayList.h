@@ -0,0 +1,162 @@
+// Copyright (c) Shinya Ishikawa. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full
+// license information.
+
+#ifndef DISPLAYLIST_H_
+#define DISPLAYLIST_H_
+#define LGFX_USE_V1
+#include <M5GFX.h>
+
+#include <vector>
+
+#include "BoundingRect.h"
+#include "StripPipeline.h"
+
+namespace m5avatar {
+/**
+ * @brief The pixels a part drew, as filled rects of raw colors
+ *
+ * LovyanGFX breaks every primitive (fillEllipse, fillTriangle, fillArc...)
+ * down into clipped rects and pixels before they reach the buffer, so
+ * recording that stream captures any part without changing it. Vertically
+ * adjacent rects of the same span and color are merged as they come in.
+ *
+ * Colors are raw values of the color depth the list was recorded at.
+ */
+class DisplayList {
+ public:
+  struct Command {
+    int16_t x;
+    int16_t y;
+    int16_t w;
+    int16_t h;
+    uint32_t color;
+  };
+
+ private:
+  std::vector<Command> commands_;
+  BoundingRect bounds_;
+  uint32_t hash_;
+  bool hashed_;
+
+ public:
+  DisplayList();
+  ~DisplayList() = default;
+  DisplayList(const DisplayList &other) = delete;
+  DisplayList &operator=(const DisplayList &other) = delete;
+
+  // empty the list, keeping its memory for the next frame
+  void clear();
+  void add(int16_t x, int16_t y, int16_t w, int16_t h, uint32_t color);
+  size_t size() const;
+  const Command *begin() const;
+  const Command *end() const;
+  // the rect covering every command, empty for an empty list
+  BoundingRect getBounds() const;
+  // hash of the commands, equal lists draw the same pixels
+  uint32_t getHash();
+  bool operator==(const DisplayList &other) const;
+  bool operator!=(const DisplayList &other) const;
+
+  /**
+   * @brief Draw the commands into the target, moved by dx, dy
+   *
+   * The target must have the color depth the list was recorded at. The
+   * commands are clipped to the target's clip rect, so a list recorded for
+   * the whole face can be replayed into a strip of it.
+   */
+  void replay(lgfx::LovyanGFX *target, int32_t dx = 0, int32_t dy = 0) const;
+};
+
+/**
+ * @brief A canvas recording what is drawn into a DisplayList
+ *
+ * Pass it to Drawable::draw instead of the face canvas: nothing is written
+ * to a buffer, the rects LovyanGFX produces are appended to the list.
+ * Buffer-based calls (pushSprite into it, copyToCanvas, readPixel) are not
+ * recorded.
+ */
+class RecordingCanvas : public M5Canvas {
+ private:
+  class RecordingPanel : public lgfx::Panel_Sprite {
+   public:
+    DisplayList *list = nullptr;
+
+    void setSize(int16_t width, int16_t height);
+    void drawPixelPreclipped(uint_fast16_t x, uint_fast16_t y,
+                             uint32_t rawcolor) override;
+    void writeFillRectPreclipped(uint_fast16_t x, uint_fast16_t y,
+                                 uint_fast16_t w, uint_fast16_t h,
+                                 uint32_t rawcolor) override;
+    // images have no buffer to go to
+    void writeBlock(uint32_t rawcolor, uint32_t length) override {}
+    void writePixels(lgfx::pixelcopy_t *param, uint32_t len,
+                     bool use_dma) override {}
+    void writeImage(uint_fast16_t x, uint_fast16_t y, uint_fast16_t w,
+                    uint_fast16_t h, lgfx::pixelcopy_t *param,
+                    bool use_dma) override {}
+    void writeImageARGB(uint_fast16_t x, uint_fast16_t y, uint_fast16_t w,
+                        uint_fast16_t h, lgfx::pixelcopy_t *param) override {}
+    void copyRect(uint_fast16_t dst_x, uint_fast16_t dst_y, uint_fast16_t w,
+                  uint_fast16_t h, uint_fast16_t src_x,
+                  uint_fast16_t src_y) override {}
+  };
+
+  RecordingPanel panel_;
+
+ public:
+  RecordingCanvas();
+  RecordingCanvas(const RecordingCanvas &other) = delete;
+  RecordingCanvas &operator=(const RecordingCanvas &other) = delete;
+
+  /**
+   * @brief Record what is drawn next into list, which is cleared
+   *
+   * The canvas takes the size and the color depth of the canvas the list
+   * will be replayed into, and has no clip rect.
+   */
+  void begin(DisplayList *list, int16_t width, int16_t height, int colorDepth);
+  // stop recording, what is drawn next is dropped
+  void end();
+};
+
+/**
+ * @brief Draws the strips from display lists, without a canvas of the face
+ *
+ * The lists are replayed into each strip, clipped to it. While the face is
+ * rotated or scaled, each strip row is mapped back to a line through the
+ * face and every command fills the pixels sampling it, the nearest pixel
+ * like pushRotateZoom. Nothing but the strip is written, so no memory is
+ * taken besides the strips; the time grows with rows * commands instead.
+ *
+ * The lists must be recorded at the color depth of the display.
+ */
+class DisplayListRenderer : public StripRenderer {
+ public:
+  static constexpr int kMaxLists = 16;
+
+ private:
+  const DisplayList *lists_[kMaxLists];
+  int count_;
+  // size of the face the lists were recorded for
+  int16_t width_;
+  int16_t height_;
+
+  void replayAll(lgfx::LovyanGFX *target, int32_t dx, int32_t dy) const;
+
+ public:
+  DisplayListRenderer();
+  DisplayListRenderer(const DisplayListRenderer &other) = delete;
+  DisplayListRenderer &operator=(const DisplayListRenderer &other) = delete;
+
+  // start a frame of a face of this size, with no lists
+  void reset(int16_t width, int16_t height);
+  // lists are replayed in the order they are added, false if full
+  bool add(const DisplayList *list);
+  void render(M5Canvas *strip, const StripSource &source, int16_t x,
+              int16_t y, int16_t w) const override;
+};
+
+}  // namespace m5avatar
+
+#endif  // DISPLAYLIST_H_
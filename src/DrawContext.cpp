@@ -23,6 +23,21 @@ DrawContext::DrawContext(Expression expression, float breath,
                          String speechText, float rotation, float scale,
                          int colorDepth, BatteryIconStatus batteryIconStatus,
                          int32_t batteryLevel, const lgfx::IFont* speechFont)
+    : DrawContext(expression, breath, palette, rightGaze, rightEyeOpenRatio,
+                  leftGaze, leftEyeOpenRatio, mouthOpenRatio, nullptr,
+                  rotation, scale, colorDepth, batteryIconStatus, batteryLevel,
+                  speechFont) {
+  ownedSpeechText = speechText;
+  this->speechText = ownedSpeechText.c_str();
+}
+
+DrawContext::DrawContext(Expression expression, float breath,
+                         ColorPalette* const palette, Gaze rightGaze,
+                         float rightEyeOpenRatio, Gaze leftGaze,
+                         float leftEyeOpenRatio, float mouthOpenRatio,
+                         const char* speechText, float rotation, float scale,
+                         int colorDepth, BatteryIconStatus batteryIconStatus,
+                         int32_t batteryLevel, const lgfx::IFont* speechFont)
     : expression{expression},
       breath{breath},
       rightGaze{rightGaze},
@@ -31,13 +46,17 @@ DrawContext::DrawContext(Expression expression, float breath,
       leftEyeOpenRatio{leftEyeOpenRatio},
       mouthOpenRatio{mouthOpenRatio},
       palette{palette},
-      speechText{speechText},
+      speechText{speechText != nullptr ? speechText : ""},
       rotation{rotation},
       scale{scale},
       colorDepth{colorDepth},
       batteryIconStatus(batteryIconStatus),
       batteryLevel(batteryLevel),
-      speechFont{speechFont} {}
+      speechFont{speechFont} {
+  if (palette != nullptr) {
+    palette->resolve(colorDepth);
+  }
+}
 
 Expression DrawContext::getExpression() const { return expression; }
 
@@ -57,10 +76,16 @@ float DrawContext::getRotation() const { return rotation; }
 
 float DrawContext::getScale() const { return scale; }
 
-String DrawContext::getspeechText() const { return speechText; }
+const char* DrawContext::getSpeechText() const { return speechText; }
+
+String DrawContext::getspeechText() const { return String(speechText); }
 
 ColorPalette* const DrawContext::getColorPalette() const { return palette; }
 
+uint16_t DrawContext::getColor(ColorKey key) const {
+  return palette->getResolved(key);
+}
+
 int DrawContext::getColorDepth() const { return colorDepth; }
 
 const lgfx::IFont* DrawContext::getSpeechFont() const { return speechFont; }
@@ -71,4 +96,25 @@ BatteryIconStatus DrawContext::getBatteryIconStatus() const {
 
 int32_t DrawContext::getBatteryLevel() const { return batteryLevel; }
 
+void DrawContext::setSpeechLayout(SpeechLayout layout, int32_t scroll) {
+  speechLayout = layout;
+  speechScroll = scroll;
+}
+
+SpeechLayout DrawContext::getSpeechLayout() const { return speechLayout; }
+
+int32_t DrawContext::getSpeechScroll() const { return speechScroll; }
+
+void DrawContext::setPosition(int16_t top, int16_t left) {
+  positioned = true;
+  this->top = top;
+  this->left = left;
+}
+
+bool DrawContext::hasPosition() const { return positioned; }
+
+int16_t DrawContext::getTop() const { return top; }
+
+int16_t DrawContext::getLeft() const { return left; }
+
 }  // namespace m5avatar
@@ -19,6 +19,17 @@ typedef std::string String;
 
 namespace m5avatar {
 enum BatteryIconStatus { discharging, charging, invisible, unknown };
+/**
+ * How the speech balloon lays out its text
+ */
+enum class SpeechLayout {
+  // one line, the balloon fits the text
+  Line,
+  // wrapped into lines of a fixed box, scrolling up when it is full
+  Wrap,
+  // one line of a fixed box, a window scrolling over the text
+  Ticker
+};
 class DrawContext {
  private:
   Expression expression;
@@ -34,7 +45,9 @@ class DrawContext {
   float mouthOpenRatio;
 
   ColorPalette* const palette;
-  String speechText;
+  // copy of the text given as a String, speechText points to it
+  String ownedSpeechText;
+  const char* speechText;
   float rotation = 0.0;
   float scale = 1.0;
   int colorDepth = 1;
@@ -42,6 +55,12 @@ class DrawContext {
   int32_t batteryLevel = 0;
   const lgfx::IFont* speechFont =
       nullptr;  // = &fonts::lgfxJapanGothicP_16; //  = &fonts::efontCN_10;
+  SpeechLayout speechLayout = SpeechLayout::Line;
+  int32_t speechScroll = -1;
+  // display position of the face, see setPosition()
+  bool positioned = false;
+  int16_t top = 0;
+  int16_t left = 0;
 
  public:
   DrawContext() = delete;
@@ -56,6 +75,17 @@ class DrawContext {
               float rotation, float scale, int colorDepth,
               BatteryIconStatus batteryIconStatus, int32_t batteryLevel,
               const lgfx::IFont* speechFont);
+  /**
+   * @brief Context referring to the speech text instead of copying it
+   *
+   * Nothing is allocated, so speechText must outlive the context.
+   */
+  DrawContext(Expression expression, float breath, ColorPalette* const palette,
+              Gaze rightGaze, float rightEyeOpenRatio, Gaze leftGaze,
+              float leftEyeOpenRatio, float mouthOpenRatio,
+              const char* speechText, float rotation, float scale,
+              int colorDepth, BatteryIconStatus batteryIconStatus,
+              int32_t batteryLevel, const lgfx::IFont* speechFont);
   ~DrawContext() = default;
   DrawContext(const DrawContext& other) = delete;
   DrawContext& operator=(const DrawContext& other) = delete;
@@ -69,11 +99,30 @@ class DrawContext {
   float getScale() const;
   float getRotation() const;
   ColorPalette* const getColorPalette() const;
+  // the palette color for the canvas depth, see ColorPalette::resolve()
+  uint16_t getColor(ColorKey key) const;
+  // the speech text without copying it, "" if there is none
+  const char* getSpeechText() const;
+  // a copy of the speech text, prefer getSpeechText()
   String getspeechText() const;
   int getColorDepth() const;
   BatteryIconStatus getBatteryIconStatus() const;
   int32_t getBatteryLevel() const;
   const lgfx::IFont* getSpeechFont() const;
+  // scroll is the Ticker window position, negative to follow the end
+  void setSpeechLayout(SpeechLayout layout, int32_t scroll = -1);
+  SpeechLayout getSpeechLayout() const;
+  int32_t getSpeechScroll() const;
+  /**
+   * @brief Draw the face with its top-left corner at (left, top) of the
+   * display in this frame
+   *
+   * Without it the face is drawn at the position of its bounding rect.
+   */
+  void setPosition(int16_t top, int16_t left);
+  bool hasPosition() const;
+  int16_t getTop() const;
+  int16_t getLeft() const;
 };
 }  // namespace m5avatar
 
@@ -15,6 +15,23 @@ class Drawable {
   virtual ~Drawable() = default;
   virtual void draw(M5Canvas *spi, BoundingRect rect,
                     DrawContext *drawContext) = 0;
+
+  /**
+   * @brief Report the canvas region this part may touch when drawn
+   *
+   * Face uses the regions to clear, redraw and push only the parts that
+   * changed since the last frame. The region has to cover every pixel the
+   * part writes, including masks filled with the background color.
+   *
+   * @param rect the same rect that is passed to draw()
+   * @param region overwritten with the covered region (may be empty)
+   * @return false if the region is unknown; changes to this part then
+   * redraw the whole face
+   */
+  virtual bool getRegion(BoundingRect rect, DrawContext *drawContext,
+                         BoundingRect *region) {
+    return false;
+  }
   // virtual void draw(TFT_eSPI *spi, DrawContext *drawContext) = 0;
 };
 
@@ -0,0 +1,208 @@
+// Copyright (c) Shinya Ishikawa. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full
+// license information.
+
+#include "Effect.h"
+
+namespace m5avatar {
+namespace {
+// the size the marks are laid out for
+const float kLayoutWidth = 320.0f;
+const float kLayoutHeight = 240.0f;
+
+// radius of a mark grown by the breath as the drawing functions do
+uint32_t grow(uint32_t r, float ratio, float offset) {
+  return r + floor(r * ratio * offset);
+}
+
+// same, growing with either sign of the offset
+uint32_t growAbs(uint32_t r, float ratio, float offset) {
+  return r + static_cast<uint32_t>(fabs(r * ratio * offset));
+}
+}  // namespace
+
+const Effect::MarkMask &Effect::getMask(Mark mark, uint32_t radius) {
+  MarkMask &mask = masks_[mark];
+  if (mask.radius == radius) {
+    return mask;
+  }
+  // every mark fits 2r around its x, y
+  int16_t size = radius * 4 + 8;
+  int16_t center = size / 2;
+  M5Canvas scratch;
+  scratch.setColorDepth(2);
+  if (scratch.createSprite(size, size) == nullptr) {
+    mask = MarkMask();
+    return mask;
+  }
+  scratch.fillSprite(0);
+  switch (mark) {
+    case kSweat:
+      drawSweatMark(&scratch, center, center, radius, 1);
+      break;
+    case kAnger:
+      drawAngerMark(&scratch, center, center, radius, 1, 2);
+      break;
+    case kHeart:
+      drawHeartMark(&scratch, center, center, radius, 1);
+      break;
+    case kChill:
+      // only the height follows the breath, rasterized at its largest
+      drawChillMark(&scratch, center, center, radius, 1, 1.0f);
+      break;
+    default:
+      drawBubbleMark(&scratch, center, center, radius, 1);
+      break;
+  }
+
+  // keep the bounding box of the pixels, 2 bits per pixel from the MSB
+  const uint8_t *buffer = static_cast<const uint8_t *>(scratch.getBuffer());
+  int32_t stride = (size * 2 + 7) >> 3;
+  auto pixelAt = [&](int16_t x, int16_t y) {
+    return (buffer[y * stride + (x >> 2)] >> (6 - ((x & 3) << 1))) & 3;
+  };
+  int16_t left = size, top = size, right = -1, bottom = -1;
+  for (int16_t y = 0; y < size; y++) {
+    for (int16_t x = 0; x < size; x++) {
+      if (pixelAt(x, y) != 0) {
+        left = std::min(left, x);
+        right = std::max(right, x);
+        top = std::min(top, y);
+        bottom = std::max(bottom, y);
+      }
+    }
+  }
+  mask.radius = radius;
+  mask.width = std::max(0, right - left + 1);
+  mask.height = std::max(0, bottom - top + 1);
+  mask.anchorX = center - left;
+  mask.anchorY = center - top;
+  mask.pixels.resize(mask.width * mask.height);
+  for (int16_t y = 0; y < mask.height; y++) {
+    for (int16_t x = 0; x < mask.width; x++) {
+      mask.pixels[y * mask.width + x] = pixelAt(left + x, top + y);
+    }
+  }
+  return mask;
+}
+
+void Effect::drawMask(M5Canvas *spi, const MarkMask &mask, float x, float y,
+                      float zoomX, float zoomY, uint16_t color,
+                      uint16_t bColor) {
+  if (mask.width == 0 || zoomX <= 0.0f || zoomY <= 0.0f) {
+    return;
+  }
+  // the mask scaled around its anchor, which lands on x, y
+  int32_t left = floor(x - mask.anchorX * zoomX);
+  int32_t right = ceil(x + (mask.width - mask.anchorX) * zoomX);
+  int32_t top = floor(y - mask.anchorY * zoomY);
+  int32_t bottom = ceil(y + (mask.height - mask.anchorY) * zoomY);
+  for (int32_t dy = top; dy < bottom; dy++) {
+    int32_t sy = floor((dy + 0.5f - y) / zoomY + mask.anchorY);
+    if (sy < 0 || sy >= mask.height) {
+      continue;
+    }
+    const uint8_t *row = &mask.pixels[sy * mask.width];
+    // draw runs of the same value as lines
+    uint8_t runValue = 0;
+    int32_t runStart = left;
+    for (int32_t dx = left; dx <= right; dx++) {
+      uint8_t value = 0;
+      if (dx < right) {
+        int32_t sx = floor((dx + 0.5f - x) / zoomX + mask.anchorX);
+        value = sx >= 0 && sx < mask.width ? row[sx] : 0;
+      }
+      if (value != runValue) {
+        if (runValue != 0) {
+          spi->drawFastHLine(runStart, dy, dx - runStart,
+                             runValue == 1 ? color : bColor);
+        }
+        runValue = value;
+        runStart = dx;
+      }
+    }
+  }
+}
+
+void Effect::draw(M5Canvas *spi, BoundingRect rect, DrawContext *ctx) {
+  uint16_t primaryColor = ctx->getColor(ColorKey::Primary);
+  uint16_t bgColor = ctx->getColor(ColorKey::Background);
+  float offset = ctx->getBreath();
+  float sx = rect.getWidth() > 0 ? rect.getWidth() / kLayoutWidth : 1.0f;
+  float sy = rect.getHeight() > 0 ? rect.getHeight() / kLayoutHeight : 1.0f;
+  float s = std::min(sx, sy);
+  auto scaled = [s](uint32_t r) {
+    return std::max<uint32_t>(1, static_cast<uint32_t>(r * s + 0.5f));
+  };
+  Expression exp = ctx->getExpression();
+  switch (exp) {
+    case Expression::Doubt: {
+      uint32_t r = scaled(7);
+      uint32_t largest = grow(r, 0.2f, 1.0f);
+      float zoom = static_cast<float>(grow(r, 0.2f, -offset)) / largest;
+      drawMask(spi, getMask(kSweat, largest), 290 * sx,
+               110 * sy + floor(5 * -offset) * s, zoom, zoom, primaryColor,
+               bgColor);
+      break;
+    }
+    case Expression::Angry: {
+      uint32_t r = scaled(12);
+      uint32_t largest = growAbs(r, 0.4f, 1.0f);
+      float zoom = static_cast<float>(growAbs(r, 0.4f, offset)) / largest;
+      drawMask(spi, getMask(kAnger, largest), 280 * sx, 50 * sy, zoom, zoom,
+               primaryColor, bgColor);
+      break;
+    }
+    case Expression::Happy: {
+      uint32_t r = scaled(12);
+      uint32_t largest = grow(r, 0.4f, 1.0f);
+      float zoom = static_cast<float>(grow(r, 0.4f, offset)) / largest;
+      drawMask(spi, getMask(kHeart, largest), 280 * sx, 50 * sy, zoom, zoom,
+               primaryColor, bgColor);
+      break;
+    }
+    case Expression::Sad: {
+      uint32_t r = scaled(30);
+      float zoom = static_cast<float>(growAbs(r, 0.2f, offset)) /
+                   growAbs(r, 0.2f, 1.0f);
+      drawMask(spi, getMask(kChill, r), 270 * sx, 0, 1.0f, zoom, primaryColor,
+               bgColor);
+      break;
+    }
+    case Expression::Sleepy: {
+      uint32_t r = scaled(10);
+      uint32_t largest = grow(r, 0.2f, 1.0f);
+      float zoom = static_cast<float>(grow(r, 0.2f, offset)) / largest;
+      drawMask(spi, getMask(kBubbleLarge, largest), 290 * sx, 40 * sy, zoom,
+               zoom, primaryColor, bgColor);
+      r = scaled(6);
+      largest = grow(r, 0.2f, 1.0f);
+      zoom = static_cast<float>(grow(r, 0.2f, -offset)) / largest;
+      drawMask(spi, getMask(kBubbleSmall, largest), 270 * sx, 52 * sy, zoom,
+               zoom, primaryColor, bgColor);
+      break;
+    }
+    default:
+      // noop
+      break;
+  }
+}
+
+bool Effect::getRegion(BoundingRect rect, DrawContext *ctx,
+                       BoundingRect *region) {
+  if (ctx->getExpression() == Expression::Neutral) {
+    *region = BoundingRect(0, 0, 0, 0);
+  } else {
+    // union of every mark at its largest breath offset, the marks shrink
+    // with the smaller of the two scales so this still covers them
+    float sx = rect.getWidth() > 0 ? rect.getWidth() / kLayoutWidth : 1.0f;
+    float sy = rect.getHeight() > 0 ? rect.getHeight() / kLayoutHeight : 1.0f;
+    int left = floor(250 * sx) - 1;
+    int top = 0;
+    *region = BoundingRect(top, left, ceil(306 * sx) + 1 - left,
+                           ceil(130 * sy) + 1);
+  }
+  return true;
+}
+
+}  // namespace m5avatar
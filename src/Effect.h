@@ -6,6 +6,9 @@
 #define EFFECT_H_
 #define LGFX_USE_V1
 #include <M5GFX.h>
+
+#include <vector>
+
 #include "DrawContext.h"
 #include "Drawable.h"
 
@@ -13,6 +16,35 @@ namespace m5avatar {
 
 class Effect final : public Drawable {
  private:
+  enum Mark {
+    kSweat,
+    kAnger,
+    kHeart,
+    kChill,
+    kBubbleLarge,
+    kBubbleSmall,
+    kMarkCount
+  };
+
+  // a mark rasterized once at its largest size, the breath only scales it
+  struct MarkMask {
+    // the radius it was rasterized at, 0 if not yet
+    uint32_t radius = 0;
+    int16_t width = 0;
+    int16_t height = 0;
+    // where the x, y of the drawing function fall in the mask
+    int16_t anchorX = 0;
+    int16_t anchorY = 0;
+    // 0 for nothing, 1 for the color and 2 for the background color
+    std::vector<uint8_t> pixels;
+  };
+
+  MarkMask masks_[kMarkCount];
+
+  const MarkMask &getMask(Mark mark, uint32_t radius);
+  void drawMask(M5Canvas *spi, const MarkMask &mask, float x, float y,
+                float zoomX, float zoomY, uint16_t color, uint16_t bColor);
+
   void drawBubbleMark(M5Canvas *spi, uint32_t x, uint32_t y, uint32_t r,
                       uint16_t color) {
     drawBubbleMark(spi, x, y, r, color, 0);
@@ -87,35 +119,12 @@ class Effect final : public Drawable {
   // constructor
   Effect() = default;
   ~Effect() = default;
-  Effect(const Effect &other) = default;
-  Effect &operator=(const Effect &other) = default;
-  void draw(M5Canvas *spi, BoundingRect rect, DrawContext *ctx) override {
-    uint16_t primaryColor = ctx->getColorDepth() == 1 ? 1 : ctx->getColorPalette()->get(COLOR_PRIMARY);
-    uint16_t bgColor = ctx->getColorDepth() == 1 ? ERACER_COLOR : ctx->getColorPalette()->get(COLOR_BACKGROUND);
-    float offset = ctx->getBreath();
-    Expression exp = ctx->getExpression();
-    switch (exp) {
-      case Expression::Doubt:
-        drawSweatMark(spi, 290, 110, 7, primaryColor, -offset);
-        break;
-      case Expression::Angry:
-        drawAngerMark(spi, 280, 50, 12, primaryColor, bgColor, offset);
-        break;
-      case Expression::Happy:
-        drawHeartMark(spi, 280, 50, 12, primaryColor, offset);
-        break;
-      case Expression::Sad:
-        drawChillMark(spi, 270, 0, 30, primaryColor, offset);
-        break;
-      case Expression::Sleepy:
-        drawBubbleMark(spi, 290, 40, 10, primaryColor, offset);
-        drawBubbleMark(spi, 270, 52, 6, primaryColor, -offset);
-        break;
-      default:
-        // noop
-        break;
-    }
-  }
+  Effect(const Effect &other) = delete;
+  Effect &operator=(const Effect &other) = delete;
+  // rect is the whole face, the marks are laid out for 320x240 and scaled
+  void draw(M5Canvas *spi, BoundingRect rect, DrawContext *ctx) override;
+  bool getRegion(BoundingRect rect, DrawContext *ctx,
+                 BoundingRect *region) override;
 };
 
 }  // namespace m5avatar
@@ -19,12 +19,8 @@ void Eye::draw(M5Canvas *spi, BoundingRect rect, DrawContext *ctx) {
       this->isLeft ? ctx->getLeftEyeOpenRatio() : ctx->getRightEyeOpenRatio();
   uint32_t offsetX = g.getHorizontal() * 3;
   uint32_t offsetY = g.getVertical() * 3;
-  uint16_t primaryColor = ctx->getColorDepth() == 1
-                              ? 1
-                              : ctx->getColorPalette()->get(COLOR_PRIMARY);
-  uint16_t backgroundColor =
-      ctx->getColorDepth() == 1 ? 0
-                                : ctx->getColorPalette()->get(COLOR_BACKGROUND);
+  uint16_t primaryColor = ctx->getColor(ColorKey::Primary);
+  uint16_t backgroundColor = ctx->getColor(ColorKey::Background);
 
   if (openRatio > 0) {
     spi->fillCircle(x + offsetX, y + offsetY, r, primaryColor);
@@ -59,4 +55,12 @@ void Eye::draw(M5Canvas *spi, BoundingRect rect, DrawContext *ctx) {
     spi->fillRect(x1, y1, w, h, primaryColor);
   }
 }
+
+bool Eye::getRegion(BoundingRect rect, DrawContext *ctx, BoundingRect *region) {
+  // gaze moves the eye by up to 3px and the happy mask is 4px wider
+  int16_t half = r + 8;
+  *region = BoundingRect(rect.getCenterY() - half, rect.getCenterX() - half,
+                         half * 2, half * 2);
+  return true;
+}
 }  // namespace m5avatar
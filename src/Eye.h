@@ -27,6 +27,8 @@ class Eye final : public Drawable {
   Eye &operator=(const Eye &other) = default;
   void draw(M5Canvas *spi, BoundingRect rect,
             DrawContext *drawContext) override;
+  bool getRegion(BoundingRect rect, DrawContext *drawContext,
+                 BoundingRect *region) override;
   // void draw(TFT_eSPI *spi, DrawContext *drawContext) override; // deprecated
 };
 
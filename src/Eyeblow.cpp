@@ -12,7 +12,7 @@ void Eyeblow::draw(M5Canvas *spi, BoundingRect rect, DrawContext *ctx) {
   Expression exp = ctx->getExpression();
   uint32_t x = rect.getLeft();
   uint32_t y = rect.getTop();
-  uint16_t primaryColor = ctx->getColorDepth() == 1 ? 1 : ctx->getColorPalette()->get(COLOR_PRIMARY);
+  uint16_t primaryColor = ctx->getColor(ColorKey::Primary);
   if (width == 0 || height == 0) {
     return;
   }
@@ -42,4 +42,17 @@ void Eyeblow::draw(M5Canvas *spi, BoundingRect rect, DrawContext *ctx) {
   }
 }
 
+bool Eyeblow::getRegion(BoundingRect rect, DrawContext *ctx,
+                        BoundingRect *region) {
+  if (width == 0 || height == 0) {
+    *region = BoundingRect(0, 0, 0, 0);
+    return true;
+  }
+  // tilted eyeblows move their corners by 3px horizontally and 5px vertically
+  *region = BoundingRect(rect.getTop() - height / 2 - 6,
+                         rect.getLeft() - width / 2 - 4, width + 8,
+                         height + 12);
+  return true;
+}
+
 }  // namespace m5avatar
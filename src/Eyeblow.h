@@ -27,6 +27,8 @@ class Eyeblow final : public Drawable {
   Eyeblow &operator=(const Eyeblow &other) = default;
   void draw(M5Canvas *spi, BoundingRect rect,
             DrawContext *drawContext) override;
+  bool getRegion(BoundingRect rect, DrawContext *drawContext,
+                 BoundingRect *region) override;
 };
 
 }  // namespace m5avatar
@@ -14,18 +14,22 @@ void BaseEyebrow::update(M5Canvas *canvas, BoundingRect rect,
                          DrawContext *ctx) {
     // common process for all standard eyebrows
     // update drawing parameters
-    ColorPalette *cp = ctx->getColorPalette();
-    primary_color_ = ctx->getColorDepth() == 1 ? 1 : cp->get(COLOR_PRIMARY);
-    secondary_color_ = ctx->getColorDepth() == 1
-                           ? 1
-                           : ctx->getColorPalette()->get(COLOR_SECONDARY);
-    background_color_ =
-        ctx->getColorDepth() == 1 ? ERACER_COLOR : cp->get(COLOR_BACKGROUND);
+    primary_color_ = ctx->getColor(ColorKey::Primary);
+    secondary_color_ = ctx->getColor(ColorKey::Secondary);
+    background_color_ = ctx->getColor(ColorKey::Background);
     center_x_ = rect.getCenterX();
     center_y_ = rect.getCenterY();
     expression_ = ctx->getExpression();
 }
 
+bool BaseEyebrow::getRegion(BoundingRect rect, DrawContext *ctx,
+                            BoundingRect *region) {
+    int16_t half = (width_ + height_) / 2 + 2;
+    *region = BoundingRect(rect.getCenterY() - half, rect.getCenterX() - half,
+                           half * 2, half * 2);
+    return true;
+}
+
 void EllipseEyebrow::draw(M5Canvas *canvas, BoundingRect rect,
                           DrawContext *ctx) {
     this->update(canvas, rect, ctx);
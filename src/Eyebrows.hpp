@@ -36,6 +36,8 @@ class BaseEyebrow : public Drawable {
     BaseEyebrow(bool is_left);
     BaseEyebrow(uint16_t width, uint16_t height, bool is_left);
     void update(M5Canvas *canvas, BoundingRect rect, DrawContext *ctx);
+    // covers the eyebrow rotated by any angle
+    bool getRegion(BoundingRect rect, DrawContext *ctx, BoundingRect *region);
 };
 
 // Maro Mayu
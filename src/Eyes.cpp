@@ -1,6 +1,10 @@
 #include "Eyes.hpp"
 
 namespace m5avatar {
+// fixed iris colors, not taken from the palette
+const uint16_t kGirlyEyeAccentColor = lgfx::color565(0x01, 0x9E, 0x73);
+const uint16_t kPinkDemonEyeAccentColor = lgfx::color565(0x00, 0xA1, 0xFF);
+
 BaseEye::BaseEye(bool is_left) : BaseEye(36, 70, is_left) {}
 
 BaseEye::BaseEye(uint16_t width, uint16_t height, bool is_left) {
@@ -15,13 +19,9 @@ void BaseEye::update(M5Canvas *canvas, BoundingRect rect, DrawContext *ctx) {
     center_x_ = rect.getCenterX();
     center_y_ = rect.getCenterY();
     gaze_ = this->is_left_ ? ctx->getLeftGaze() : ctx->getRightGaze();
-    ColorPalette *cp = ctx->getColorPalette();
-    primary_color_ = ctx->getColorDepth() == 1 ? 1 : cp->get(COLOR_PRIMARY);
-    secondary_color_ = ctx->getColorDepth() == 1
-                           ? 1
-                           : ctx->getColorPalette()->get(COLOR_SECONDARY);
-    background_color_ =
-        ctx->getColorDepth() == 1 ? ERACER_COLOR : cp->get(COLOR_BACKGROUND);
+    primary_color_ = ctx->getColor(ColorKey::Primary);
+    secondary_color_ = ctx->getColor(ColorKey::Secondary);
+    background_color_ = ctx->getColor(ColorKey::Background);
 
     // offset computed from gaze direction
     shifted_x_ = center_x_ + gaze_.getHorizontal() * 8;
@@ -31,6 +31,16 @@ void BaseEye::update(M5Canvas *canvas, BoundingRect rect, DrawContext *ctx) {
     expression_ = ctx->getExpression();
 }
 
+bool BaseEye::getRegion(BoundingRect rect, DrawContext *ctx,
+                        BoundingRect *region) {
+    // gaze shifts the eye by 8px, tilted eyelids and eyelashes reach about
+    // one and a half eye size plus the eyelash length around the center
+    int16_t half = std::max(width_, height_) * 3 / 2 + 48;
+    *region = BoundingRect(rect.getCenterY() - half, rect.getCenterX() - half,
+                           half * 2, half * 2);
+    return true;
+}
+
 void EllipseEye::draw(M5Canvas *canvas, BoundingRect rect, DrawContext *ctx) {
     this->update(canvas, rect, ctx);
     if (open_ratio_ == 0 || expression_ == Expression::Sleepy) {
@@ -99,6 +109,16 @@ void EllipseEye::draw(M5Canvas *canvas, BoundingRect rect, DrawContext *ctx) {
     }
 }
 
+bool EllipseEye::getRegion(BoundingRect rect, DrawContext *ctx,
+                           BoundingRect *region) {
+    // gaze shifts the eye by 8px horizontally and 5px vertically,
+    // the happy eye mask reaches 8px below the ellipse
+    *region = BoundingRect(rect.getCenterY() - height_ / 2 - 6,
+                           rect.getCenterX() - width_ / 2 - 9, width_ + 19,
+                           height_ + 20);
+    return true;
+}
+
 void GirlyEye::drawEyeLid(M5Canvas *canvas) {
     // eyelid
     auto upper_eyelid_y = shifted_y_ - 0.8f * height_ / 2 +
@@ -198,7 +218,7 @@ void GirlyEye::draw(M5Canvas *canvas, BoundingRect rect, DrawContext *ctx) {
         canvas->fillEllipse(shifted_x_, shifted_y_, this->width_ / 2,
                             this->height_ / 2, primary_color_);
 
-        uint16_t accent_color = M5.Lcd.color24to16(0x019E73);
+        uint16_t accent_color = kGirlyEyeAccentColor;
         canvas->fillEllipse(shifted_x_, shifted_y_,
                             this->width_ / 2 - thickness,
                             this->height_ / 2 - thickness, accent_color);
@@ -289,7 +309,7 @@ void PinkDemonEye::draw(M5Canvas *canvas, BoundingRect rect, DrawContext *ctx) {
         // bg
         canvas->fillEllipse(shifted_x_, shifted_y_, this->width_ / 2,
                             this->height_ / 2, primary_color_);
-        uint16_t accent_color = M5.Lcd.color24to16(0x00A1FF);
+        uint16_t accent_color = kPinkDemonEyeAccentColor;
         canvas->fillEllipse(shifted_x_, shifted_y_,
                             this->width_ / 2 - thickness,
                             this->height_ / 2 - thickness, accent_color);
@@ -324,4 +344,11 @@ void DoggyEye::draw(M5Canvas *canvas, BoundingRect rect, DrawContext *ctx) {
                         background_color_);
 }
 
+bool DoggyEye::getRegion(BoundingRect rect, DrawContext *ctx,
+                         BoundingRect *region) {
+    *region = BoundingRect(rect.getCenterY() - 27, rect.getCenterX() - 32, 65,
+                           55);
+    return true;
+}
+
 }  // namespace m5avatar
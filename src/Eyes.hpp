@@ -40,12 +40,15 @@ class BaseEye : public Drawable {
     BaseEye(bool is_left);
     BaseEye(uint16_t width, uint16_t height, bool is_left);
     void update(M5Canvas *canvas, BoundingRect rect, DrawContext *ctx);
+    // conservative region covering eyelids, eyelashes and their tilt
+    bool getRegion(BoundingRect rect, DrawContext *ctx, BoundingRect *region);
 };
 
 class EllipseEye : public BaseEye {
    public:
     using BaseEye::BaseEye;
     void draw(M5Canvas *canvas, BoundingRect rect, DrawContext *ctx);
+    bool getRegion(BoundingRect rect, DrawContext *ctx, BoundingRect *region);
 };
 
 class GirlyEye : public BaseEye {
@@ -68,6 +71,7 @@ class DoggyEye : public BaseEye {
    public:
     using BaseEye::BaseEye;
     void draw(M5Canvas *canvas, BoundingRect rect, DrawContext *ctx);
+    bool getRegion(BoundingRect rect, DrawContext *ctx, BoundingRect *region);
 };
 }  // namespace m5avatar
 
@@ -8,108 +8,111 @@
 #define _min(a, b) std::min(a, b)
 #endif
 
-//#define DISPLAY_WIDTH 1280
-//#define DISPLAY_HEIGH
-#define DISPLAY_WIDTH  720 
-#define DISPLAY_HEIGHT 1280
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
 
 namespace m5avatar {
 BoundingRect br;
 
-Face::Face(M5GFX* display)
-{
-    // Calculate positions based on display dimensions
-    int w = DISPLAY_WIDTH; //720; //display->width();
-    int h = DISPLAY_HEIGHT;  //display->height();
-    float scaleX = w / 320.0f;
-    float scaleY = h / 240.0f;
-    
-    // Scale mouth dimensions relative to screen size
-    uint16_t mouthMinWidth = static_cast<uint16_t>(50 * scaleX);
-    uint16_t mouthMaxWidth = static_cast<uint16_t>(90 * scaleX);
-    uint16_t mouthMinHeight = static_cast<uint16_t>(4 * scaleY);
-    uint16_t mouthMaxHeight = static_cast<uint16_t>(60 * scaleY);
-    
-    // Scale eye radius relative to screen size
-    uint16_t eyeRadius = static_cast<uint16_t>(8 * scaleX);
-    
-    // Scale eyeblow dimensions relative to screen size
-    uint16_t eyeblowWidth = static_cast<uint16_t>(32 * scaleX);
-    uint16_t eyeblowHeight = static_cast<uint16_t>(4 * scaleY);
-    
-    // Create face with scaled dimensions for all components
-    *this = Face(new Mouth(mouthMinWidth, mouthMaxWidth, mouthMinHeight, mouthMaxHeight), 
-                 new Eye(eyeRadius, false), new Eye(eyeRadius, true),
-                 new Eyeblow(eyeblowWidth, eyeblowHeight, false), 
-                 new Eyeblow(eyeblowWidth, eyeblowHeight, true), 
-                 display);
+// index of each part in the per-frame arrays of Face::draw
+enum PartIndex {
+  kMouth,
+  kEyeR,
+  kEyeL,
+  kEyeblowR,
+  kEyeblowL,
+  kBalloon,
+  kEffect
+};
+
+// the layer of each part, see FaceLayer
+static const FaceLayer kPartLayers[] = {
+    FaceLayer::Dynamic, FaceLayer::Dynamic, FaceLayer::Dynamic,
+    FaceLayer::Static,  FaceLayer::Static,  FaceLayer::Overlay,
+    FaceLayer::Overlay};
+
+// the default face is laid out for 320x240 and scaled to the face size
+static constexpr int16_t kLayoutWidth = 320;
+static constexpr int16_t kLayoutHeight = 240;
+
+// the given size, or the display's when it is 0
+static int16_t widthOf(lgfx::LovyanGFX *display, int16_t width) {
+  if (width > 0) {
+    return width;
+  }
+  // the display reports 0 until it is initialized by M5.begin()
+  return display->width() > 0 ? display->width() : kLayoutWidth;
 }
 
-Face::Face(Drawable *mouth, Drawable *eyeR, Drawable *eyeL, Drawable *eyeblowR,
-           Drawable *eyeblowL, M5GFX* display)
-{
-    // Calculate positions based on display dimensions
-    int w = DISPLAY_WIDTH; //display->width();
-    int h = DISPLAY_HEIGHT;  //display->height();
-    float scaleX = w / 320.0f;
-    float scaleY = h / 240.0f;
-    
-    // Calculate scaled positions
-    int mouthTop = static_cast<int>(148 * scaleY);
-    int mouthLeft = static_cast<int>(163 * scaleX);
-    int eyeRTop = static_cast<int>(93 * scaleY);
-    int eyeRLeft = static_cast<int>(90 * scaleX);
-    int eyeLTop = static_cast<int>(96 * scaleY);
-    int eyeLLeft = static_cast<int>(230 * scaleX);
-    int eyeblowRTop = static_cast<int>(67 * scaleY);
-    int eyeblowRLeft = static_cast<int>(96 * scaleX);
-    int eyeblowLTop = static_cast<int>(72 * scaleY);
-    int eyeblowLLeft = static_cast<int>(230 * scaleX);
-    
-    // Use delegation to the next constructor instead of assignment
-    mouth_ = mouth;
-    eyeR_ = eyeR;
-    eyeL_ = eyeL;
-    eyeblowR_ = eyeblowR;
-    eyeblowL_ = eyeblowL;
-    mouthPos_ = new BoundingRect(mouthTop, mouthLeft);
-    eyeRPos_ = new BoundingRect(eyeRTop, eyeRLeft);
-    eyeLPos_ = new BoundingRect(eyeLTop, eyeLLeft);
-    eyeblowRPos_ = new BoundingRect(eyeblowRTop, eyeblowRLeft);
-    eyeblowLPos_ = new BoundingRect(eyeblowLTop, eyeblowLLeft);
-    boundingRect_ = new BoundingRect(0, 0, w, h);
-    sprite_ = new M5Canvas(display);
-    tmpSprite_ = new M5Canvas(display);
-    b_ = new Balloon();
-    h_ = new Effect();
-    battery_ = new BatteryIcon();
+static int16_t heightOf(lgfx::LovyanGFX *display, int16_t height) {
+  if (height > 0) {
+    return height;
+  }
+  return display->height() > 0 ? display->height() : kLayoutHeight;
+}
+
+static uint16_t layoutX(int x, int16_t width) {
+  return x * width / kLayoutWidth;
+}
+
+static uint16_t layoutY(int y, int16_t height) {
+  return y * height / kLayoutHeight;
 }
 
+// NOTE: delegate instead of assigning a temporary Face to *this, since the
+// temporary's destructor would delete the parts and buffers we keep.
+Face::Face(lgfx::LovyanGFX *display, int16_t width, int16_t height)
+    : Face(new Mouth(layoutX(50, widthOf(display, width)),
+                     layoutX(90, widthOf(display, width)),
+                     layoutY(4, heightOf(display, height)),
+                     layoutY(60, heightOf(display, height))),
+           new Eye(layoutX(8, widthOf(display, width)), false),
+           new Eye(layoutX(8, widthOf(display, width)), true),
+           new Eyeblow(layoutX(32, widthOf(display, width)),
+                       layoutY(4, heightOf(display, height)), false),
+           new Eyeblow(layoutX(32, widthOf(display, width)),
+                       layoutY(4, heightOf(display, height)), true),
+           display, width, height) {
+  // resize() lays these out again for the new size
+  layoutParts_[0] = mouth_;
+  layoutParts_[1] = eyeR_;
+  layoutParts_[2] = eyeL_;
+  layoutParts_[3] = eyeblowR_;
+  layoutParts_[4] = eyeblowL_;
+}
+
+Face::Face(Drawable *mouth, Drawable *eyeR, Drawable *eyeL, Drawable *eyeblowR,
+           Drawable *eyeblowL, lgfx::LovyanGFX *display, int16_t width,
+           int16_t height)
+    // positions are scaled from the 320x240 layout to the face size
+    : Face(mouth,
+           new BoundingRect(layoutY(148, heightOf(display, height)),
+                            layoutX(163, widthOf(display, width))),
+           eyeR,
+           new BoundingRect(layoutY(93, heightOf(display, height)),
+                            layoutX(90, widthOf(display, width))),
+           eyeL,
+           new BoundingRect(layoutY(96, heightOf(display, height)),
+                            layoutX(230, widthOf(display, width))),
+           eyeblowR,
+           new BoundingRect(layoutY(67, heightOf(display, height)),
+                            layoutX(96, widthOf(display, width))),
+           eyeblowL,
+           new BoundingRect(layoutY(72, heightOf(display, height)),
+                            layoutX(230, widthOf(display, width))),
+           display, width, height) {}
+
 Face::Face(Drawable *mouth, BoundingRect *mouthPos, Drawable *eyeR,
            BoundingRect *eyeRPos, Drawable *eyeL, BoundingRect *eyeLPos,
            Drawable *eyeblowR, BoundingRect *eyeblowRPos, Drawable *eyeblowL,
-           BoundingRect *eyeblowLPos, M5GFX* display)
-{
-    int w = DISPLAY_WIDTH; //display->width();
-    int h = DISPLAY_HEIGHT;  //display->height();
-    
-    mouth_ = mouth;
-    eyeR_ = eyeR;
-    eyeL_ = eyeL;
-    eyeblowR_ = eyeblowR;
-    eyeblowL_ = eyeblowL;
-    mouthPos_ = mouthPos;
-    eyeRPos_ = eyeRPos;
-    eyeLPos_ = eyeLPos;
-    eyeblowRPos_ = eyeblowRPos;
-    eyeblowLPos_ = eyeblowLPos;
-    boundingRect_ = new BoundingRect(0, 0, w, h);
-    sprite_ = new M5Canvas(display);
-    tmpSprite_ = new M5Canvas(display);
-    b_ = new Balloon();
-    h_ = new Effect();
-    battery_ = new BatteryIcon();
-}
+           BoundingRect *eyeblowLPos, lgfx::LovyanGFX *display, int16_t width,
+           int16_t height)
+    : Face(mouth, mouthPos, eyeR, eyeRPos, eyeL, eyeLPos, eyeblowR,
+           eyeblowRPos, eyeblowL, eyeblowLPos,
+           new BoundingRect(0, 0, widthOf(display, width),
+                            heightOf(display, height)),
+           new M5Canvas(display), new M5Canvas(display)) {}
 
 Face::Face(Drawable *mouth, BoundingRect *mouthPos, Drawable *eyeR,
        BoundingRect *eyeRPos, Drawable *eyeL, BoundingRect *eyeLPos,
@@ -128,10 +131,23 @@ Face::Face(Drawable *mouth, BoundingRect *mouthPos, Drawable *eyeR,
       eyeblowLPos_(eyeblowLPos),
       boundingRect_(boundingRect),
       sprite_(spr),
-      tmpSprite_(tmpSpr),
+      strips_(tmpSpr, new M5Canvas(tmpSpr->getParent())),
+      stats_(nullptr),
       b_(new Balloon()),
       h_(new Effect()),
-      battery_(new BatteryIcon()) {}
+      battery_(new BatteryIcon()),
+      layoutParts_{},
+      canvasWidth_(0),
+      canvasHeight_(0),
+      canvasDepth_(0),
+      blitMode_(BlitMode::Auto),
+      accessoryCount_(0),
+      accessoryFrame_(0),
+      revision_(0),
+      recording_(false),
+      renderMode_(RenderMode::Canvas),
+      hasLastFrame_(false),
+      lastFrameKey_(0) {}
 
 Face::~Face() {
   delete mouth_;
@@ -145,18 +161,114 @@ Face::~Face() {
   delete eyeblowL_;
   delete eyeblowLPos_;
   delete sprite_;
-  delete tmpSprite_;
   delete boundingRect_;
   delete b_;
   delete h_;
   delete battery_;
 }
 
-void Face::setMouth(Drawable *mouth) { this->mouth_ = mouth; }
+// scale the rect's position from one face size to another
+static void scalePosition(BoundingRect *rect, int16_t fromWidth,
+                          int16_t fromHeight, int16_t toWidth,
+                          int16_t toHeight) {
+  rect->setPosition(rect->getTop() * toHeight / fromHeight,
+                    rect->getLeft() * toWidth / fromWidth);
+}
 
-void Face::setLeftEye(Drawable *eyeL) { this->eyeL_ = eyeL; }
+void Face::resize(int16_t width, int16_t height) {
+  int16_t fromWidth = boundingRect_->getWidth();
+  int16_t fromHeight = boundingRect_->getHeight();
+  if (width <= 0 || height <= 0 ||
+      (width == fromWidth && height == fromHeight)) {
+    return;
+  }
+  if (fromWidth > 0 && fromHeight > 0) {
+    BoundingRect *positions[] = {mouthPos_, eyeRPos_, eyeLPos_, eyeblowRPos_,
+                                 eyeblowLPos_};
+    for (BoundingRect *position : positions) {
+      scalePosition(position, fromWidth, fromHeight, width, height);
+    }
+    for (int i = 0; i < accessoryCount_; i++) {
+      scalePosition(&accessories_[i].position, fromWidth, fromHeight, width,
+                    height);
+    }
+  }
+  // the default parts are sized for the face, the objects are kept since
+  // callers may hold them
+  if (mouth_ == layoutParts_[0] && mouth_ != nullptr) {
+    *static_cast<Mouth *>(mouth_) =
+        Mouth(layoutX(50, width), layoutX(90, width), layoutY(4, height),
+              layoutY(60, height));
+  }
+  if (eyeR_ == layoutParts_[1] && eyeR_ != nullptr) {
+    *static_cast<Eye *>(eyeR_) = Eye(layoutX(8, width), false);
+  }
+  if (eyeL_ == layoutParts_[2] && eyeL_ != nullptr) {
+    *static_cast<Eye *>(eyeL_) = Eye(layoutX(8, width), true);
+  }
+  if (eyeblowR_ == layoutParts_[3] && eyeblowR_ != nullptr) {
+    *static_cast<Eyeblow *>(eyeblowR_) =
+        Eyeblow(layoutX(32, width), layoutY(4, height), false);
+  }
+  if (eyeblowL_ == layoutParts_[4] && eyeblowL_ != nullptr) {
+    *static_cast<Eyeblow *>(eyeblowL_) =
+        Eyeblow(layoutX(32, width), layoutY(4, height), true);
+  }
+  boundingRect_->setSize(width, height);
+  invalidate();
+}
 
-void Face::setRightEye(Drawable *eyeR) { this->eyeR_ = eyeR; }
+void Face::setMouth(Drawable *mouth) {
+  this->mouth_ = mouth;
+  invalidate();
+}
+
+void Face::setLeftEye(Drawable *eyeL) {
+  this->eyeL_ = eyeL;
+  invalidate();
+}
+
+void Face::setRightEye(Drawable *eyeR) {
+  this->eyeR_ = eyeR;
+  invalidate();
+}
+
+void Face::invalidate() {
+  hasLastFrame_ = false;
+  revision_++;
+}
+
+uint32_t Face::getRevision() const { return revision_; }
+
+bool Face::isAnimated() const {
+  for (int i = 0; i < accessoryCount_; i++) {
+    if (accessories_[i].layer != FaceLayer::Static) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void Face::setBlitMode(BlitMode mode) { blitMode_ = mode; }
+
+BlitMode Face::getBlitMode() const { return blitMode_; }
+
+void Face::setStripHeight(uint8_t rows) { strips_.setHeight(rows); }
+
+uint8_t Face::getStripHeight() const { return strips_.getHeight(); }
+
+void Face::setStripThreadCount(uint8_t threads) {
+  strips_.setThreadCount(threads);
+}
+
+uint8_t Face::getStripThreadCount() const { return strips_.getThreadCount(); }
+
+void Face::setFrameStats(FrameStats *stats) {
+  stats_ = stats;
+  strips_.setFrameStats(stats);
+}
+
+Balloon *Face::getBalloon() { return b_; }
 
 Drawable *Face::getMouth() { return mouth_; }
 
@@ -170,107 +282,554 @@ void Face::setBoundingRect(BoundingRect *rect) {
   if (boundingRect_ != rect) {
     // Only replace if it's a different object to avoid self-deletion
     boundingRect_ = rect;
+    revision_++;
   }
 }
 
-void Face::draw(DrawContext *ctx) {
-  // Use the larger dimension to create a square canvas to ensure enough space when rotated
-  int maxDimension = std::max(boundingRect_->getWidth(), boundingRect_->getHeight());
-  sprite_->createSprite(maxDimension, maxDimension);
-  sprite_->setColorDepth(ctx->getColorDepth());
-  // NOTE: setting below for 1-bit color depth
-  sprite_->setBitmapColor(ctx->getColorPalette()->get(COLOR_PRIMARY),
-    ctx->getColorPalette()->get(COLOR_BACKGROUND));
-  if (ctx->getColorDepth() != 1) {
-    sprite_->fillSprite(ctx->getColorPalette()->get(COLOR_BACKGROUND));
-  } else {
-    sprite_->fillSprite(0);
+bool Face::prepareCanvas(DrawContext *ctx) {
+  // the canvas holds the face untransformed, rotation and zoom are applied
+  // when the strips are resampled, so it is exactly the size of the face
+  int16_t width = boundingRect_->getWidth();
+  int16_t height = boundingRect_->getHeight();
+  if (renderMode_ == RenderMode::Strips) {
+    // no canvas, the parts are recorded at the depth of the strips
+    int depth = sprite_->getParent()->getColorDepth() & 0xFF;
+    if (sprite_->getBuffer() != nullptr || width != canvasWidth_ ||
+        height != canvasHeight_ || depth != canvasDepth_) {
+      sprite_->deleteSprite();
+      hasLastFrame_ = false;
+    }
+    canvasWidth_ = width;
+    canvasHeight_ = height;
+    canvasDepth_ = depth;
+    return true;
   }
-  float breath = _min(1.0f, ctx->getBreath());
+  int depth = ctx->getColorDepth();
+  if (sprite_->getBuffer() != nullptr && width == canvasWidth_ &&
+      height == canvasHeight_ && depth == canvasDepth_) {
+    return true;
+  }
+  sprite_->deleteSprite();
+  canvasWidth_ = 0;
+  canvasHeight_ = 0;
+  hasLastFrame_ = false;
+  // NOTE: set the depth first, or createSprite allocates at the default
+  // depth and setColorDepth allocates again
+  sprite_->setColorDepth(depth);
+  if (sprite_->createSprite(width, height) == nullptr) {
+    M5_LOGE("failed to allocate %dx%d canvas (%d bpp)", width, height, depth);
+    return false;
+  }
+  canvasWidth_ = width;
+  canvasHeight_ = height;
+  canvasDepth_ = depth;
+  return true;
+}
+
+BoundingRect Face::getFrameRect(DrawContext *ctx) {
+  if (ctx->hasPosition()) {
+    return BoundingRect(ctx->getTop(), ctx->getLeft(), canvasWidth_,
+                        canvasHeight_);
+  }
+  return BoundingRect(boundingRect_->getTop(), boundingRect_->getLeft(),
+                      canvasWidth_, canvasHeight_);
+}
+
+uint32_t Face::getFrameKey(DrawContext *ctx) {
+  // anything here changes pixels outside of the parts' regions
+  ColorPalette *cp = ctx->getColorPalette();
+  Fingerprint fp;
+  fp.add(ctx->getColorDepth())
+      .add(cp->get(ColorKey::Primary))
+      .add(cp->get(ColorKey::Secondary))
+      .add(cp->get(ColorKey::Background))
+      .add(cp->get(ColorKey::BalloonForeground))
+      .add(cp->get(ColorKey::BalloonBackground))
+      .add(ctx->getRotation())
+      .add(ctx->getScale())
+      .add(getFrameRect(ctx));
+  return fp.get();
+}
+
+uint32_t Face::getPartKey(int index, BoundingRect rect, DrawContext *ctx) {
+  // inputs each kind of part reads from the context
+  Fingerprint fp;
+  fp.add(rect).add(ctx->getExpression());
+  switch (index) {
+    case kMouth:
+      fp.add(ctx->getMouthOpenRatio()).add(ctx->getBreath());
+      break;
+    case kEyeR:
+    case kEyeL:
+      fp.add(ctx->getRightGaze())
+          .add(ctx->getRightEyeOpenRatio())
+          .add(ctx->getLeftGaze())
+          .add(ctx->getLeftEyeOpenRatio());
+      break;
+    case kBalloon:
+      fp.add(ctx->getSpeechText())
+          .add(ctx->getSpeechFont())
+          .add(ctx->getSpeechLayout())
+          .add(ctx->getSpeechScroll());
+      break;
+    case kEffect:
+      fp.add(ctx->getBreath());
+      break;
+    default:
+      break;
+  }
+  return fp.get();
+}
 
-  // Defensive: check center coordinates for pushRotateZoom
-  
+BoundingRect Face::toOutputArea(BoundingRect region, DrawContext *ctx,
+                                lgfx::LovyanGFX *display) {
+  // canvas points are rotated (clockwise, in degrees) and scaled around the
+  // canvas center, which stays at the center of the frame rect
+  float rotation = ctx->getRotation();
+  float scale = ctx->getScale();
+  BoundingRect frameRect = getFrameRect(ctx);
+  float cx = canvasWidth_ / 2.0f;
+  float cy = canvasHeight_ / 2.0f;
+  float dx = frameRect.getLeft() + cx;
+  float dy = frameRect.getTop() + cy;
+  float rad = rotation * M_PI / 180.0f;
+  float cosr = cosf(rad) * scale;
+  float sinr = sinf(rad) * scale;
+  float xs[] = {(float)region.getLeft(), (float)region.getRight()};
+  float ys[] = {(float)region.getTop(), (float)region.getBottom()};
+  float minX = dx, maxX = dx, minY = dy, maxY = dy;
+  bool first = true;
+  for (float x : xs) {
+    for (float y : ys) {
+      float ox = cosr * (x - cx) - sinr * (y - cy) + dx;
+      float oy = sinr * (x - cx) + cosr * (y - cy) + dy;
+      minX = first ? ox : std::min(minX, ox);
+      maxX = first ? ox : std::max(maxX, ox);
+      minY = first ? oy : std::min(minY, oy);
+      maxY = first ? oy : std::max(maxY, oy);
+      first = false;
+    }
+  }
+  // a pixel of margin for resampling, and nothing outside of the display
+  int margin = rotation == 0.0f && scale == 1.0f ? 0 : 1;
+  int left = std::max(0, (int)floorf(minX) - margin);
+  int top = std::max(0, (int)floorf(minY) - margin);
+  int right = std::min((int)display->width(), (int)ceilf(maxX) + margin);
+  int bottom = std::min((int)display->height(), (int)ceilf(maxY) + margin);
+  if (right <= left || bottom <= top) {
+    return BoundingRect(0, 0, 0, 0);
+  }
+  return BoundingRect(top, left, right - left, bottom - top);
+}
 
-  // TODO(meganetaaan): unify drawing process of each parts
-  BoundingRect rect = *mouthPos_;
-  rect.setPosition(rect.getTop() + breath * 3, rect.getLeft());
-  // copy context to each draw function
-  mouth_->draw(sprite_, rect, ctx);
+BoundingRect Face::toCanvasArea(BoundingRect area, DrawContext *ctx) {
+  // the inverse of toOutputArea
+  float rotation = ctx->getRotation();
+  float scale = ctx->getScale();
+  BoundingRect frameRect = getFrameRect(ctx);
+  float cx = canvasWidth_ / 2.0f;
+  float cy = canvasHeight_ / 2.0f;
+  float dx = frameRect.getLeft() + cx;
+  float dy = frameRect.getTop() + cy;
+  float rad = rotation * M_PI / 180.0f;
+  float cosr = cosf(rad) / scale;
+  float sinr = sinf(rad) / scale;
+  float xs[] = {(float)area.getLeft(), (float)area.getRight()};
+  float ys[] = {(float)area.getTop(), (float)area.getBottom()};
+  float minX = cx, maxX = cx, minY = cy, maxY = cy;
+  bool first = true;
+  for (float x : xs) {
+    for (float y : ys) {
+      float ix = cosr * (x - dx) + sinr * (y - dy) + cx;
+      float iy = -sinr * (x - dx) + cosr * (y - dy) + cy;
+      minX = first ? ix : std::min(minX, ix);
+      maxX = first ? ix : std::max(maxX, ix);
+      minY = first ? iy : std::min(minY, iy);
+      maxY = first ? iy : std::max(maxY, iy);
+      first = false;
+    }
+  }
+  int margin = rotation == 0.0f && scale == 1.0f ? 0 : 1;
+  int left = std::max(0, (int)floorf(minX) - margin);
+  int top = std::max(0, (int)floorf(minY) - margin);
+  int right = std::min((int)canvasWidth_, (int)ceilf(maxX) + margin);
+  int bottom = std::min((int)canvasHeight_, (int)ceilf(maxY) + margin);
+  if (area.isEmpty() || right <= left || bottom <= top) {
+    return BoundingRect(0, 0, 0, 0);
+  }
+  return BoundingRect(top, left, right - left, bottom - top);
+}
 
-  rect = *eyeRPos_;
-  rect.setPosition(rect.getTop() + breath * 3, rect.getLeft());
-  eyeR_->draw(sprite_, rect, ctx);
+BoundingRect Face::getHudRect(DrawContext *ctx, lgfx::LovyanGFX *display) {
+  if (ctx->getBatteryIconStatus() == BatteryIconStatus::invisible) {
+    return BoundingRect(0, 0, 0, 0);
+  }
+  // upright at the top right corner of the frame rect
+  BoundingRect frameRect = getFrameRect(ctx);
+  int left = frameRect.getLeft() + canvasWidth_ - 35;
+  int top = frameRect.getTop() + 5;
+  if (left < 0 || top < 0 ||
+      left + BatteryIcon::kWidth > display->width() ||
+      top + BatteryIcon::kHeight > display->height()) {
+    return BoundingRect(0, 0, 0, 0);
+  }
+  return BoundingRect(top, left, BatteryIcon::kWidth, BatteryIcon::kHeight);
+}
 
-  rect = *eyeLPos_;
-  rect.setPosition(rect.getTop() + breath * 3, rect.getLeft());
-  eyeL_->draw(sprite_, rect, ctx);
+M5Canvas *Face::getLayerBuffer(int layer) {
+  M5Canvas *buffer = &layers_[layer].buffer;
+  return layers_[layer].buffered && renderMode_ == RenderMode::Canvas &&
+                 buffer->getBuffer() != nullptr
+             ? buffer
+             : nullptr;
+}
 
-  rect = *eyeblowRPos_;
-  rect.setPosition(rect.getTop() + breath * 3, rect.getLeft());
-  eyeblowR_->draw(sprite_, rect, ctx);
+void Face::prepareLayers() {
+  for (Layer &layer : layers_) {
+    M5Canvas *buffer = &layer.buffer;
+    if (!layer.buffered || renderMode_ == RenderMode::Strips) {
+      buffer->deleteSprite();
+      continue;
+    }
+    if (buffer->getBuffer() != nullptr && buffer->width() == canvasWidth_ &&
+        buffer->height() == canvasHeight_ &&
+        (buffer->getColorDepth() & 0xFF) == canvasDepth_) {
+      continue;
+    }
+    // the new buffer holds nothing yet
+    hasLastFrame_ = false;
+    buffer->deleteSprite();
+    buffer->setColorDepth(canvasDepth_);
+    if (buffer->createSprite(canvasWidth_, canvasHeight_) == nullptr) {
+      // composed without it
+      M5_LOGE("failed to allocate %dx%d layer buffer (%d bpp)", canvasWidth_,
+              canvasHeight_, canvasDepth_);
+    }
+  }
+}
 
-  rect = *eyeblowLPos_;
-  rect.setPosition(rect.getTop() + breath * 3, rect.getLeft());
-  eyeblowL_->draw(sprite_, rect, ctx);
+void Face::composeLayers(M5Canvas *target, BoundingRect region, int base,
+                         int top, const FrameParts &frame, DrawContext *ctx) {
+  if (region.isEmpty()) {
+    return;
+  }
+  ColorPalette *cp = ctx->getColorPalette();
+  // NOTE: setting below for 1-bit color depth
+  target->setBitmapColor(cp->get(ColorKey::Primary),
+                         cp->get(ColorKey::Background));
+  target->setClipRect(region.getLeft(), region.getTop(), region.getWidth(),
+                      region.getHeight());
+  if (base < 0 || !copyToCanvas(getLayerBuffer(base), target, 0, 0)) {
+    target->fillRect(region.getLeft(), region.getTop(), region.getWidth(),
+                     region.getHeight(), ctx->getColor(ColorKey::Background));
+    base = -1;
+  }
+  // redraw every part of the layers touching the region, layer by layer and
+  // in the usual order within a layer, so that overlapping parts and masks
+  // compose as in a full frame
+  for (int l = base + 1; l <= top; l++) {
+    for (int i = 0; i < kSlotCount; i++) {
+      if (frame.parts[i] == nullptr || static_cast<int>(frame.layers[i]) != l) {
+        continue;
+      }
+      if (frame.full || !frame.regionKnown[i] ||
+          frame.regions[i].intersects(region)) {
+        if (frame.recorded[i]) {
+          lists_[i].replay(target);
+        } else {
+          frame.parts[i]->draw(target, frame.rects[i], ctx);
+        }
+      }
+    }
+  }
+  target->clearClipRect();
+}
 
-  // TODO(meganetaaan): make balloons and effects selectable
-  b_->draw(sprite_, br, ctx);
-  h_->draw(sprite_, br, ctx);
-  battery_->draw(sprite_, br, ctx);
-  // drawAccessory(sprite, position, ctx);
+void Face::recordPart(int index, const FrameParts &frame, DrawContext *ctx) {
+  ColorPalette *cp = ctx->getColorPalette();
+  recorder_.begin(&lists_[index], canvasWidth_, canvasHeight_, canvasDepth_);
+  recorder_.setBitmapColor(cp->get(ColorKey::Primary),
+                           cp->get(ColorKey::Background));
+  frame.parts[index]->draw(&recorder_, frame.rects[index], ctx);
+  recorder_.end();
+}
 
-  // TODO(meganetaaan): rethink responsibility for transform function
-  float scale = ctx->getScale();
-  float rotation = boundingRect_ ? boundingRect_->getRotation() : 0.0f;
+void Face::setRecording(bool recording) {
+  if (recording_ != recording) {
+    recording_ = recording;
+    invalidate();
+  }
+}
 
-// ▼▼▼▼ここから▼▼▼▼
-  static constexpr uint8_t y_step = 8;
+bool Face::isRecording() const { return recording_; }
 
-  // Get the display from the sprite
-  M5GFX* display = (M5GFX*)sprite_->getParent();
+void Face::setRenderMode(RenderMode mode) {
+  if (renderMode_ != mode) {
+    renderMode_ = mode;
+    invalidate();
+  }
+}
 
-  if (tmpSprite_->getBuffer() == nullptr) {
-    // 出力先と同じcolorDepthを指定することで、DMA転送が可能になる。
-    // Display自体は16bit or 24bitしか指定できないが、細長なので1bitではなくても大丈夫。
-    tmpSprite_->setColorDepth(display->getColorDepth());
+RenderMode Face::getRenderMode() const { return renderMode_; }
 
-    // 確保するメモリは高さ8ピクセルの横長の細長い短冊状とする。
-    // Use the same maxDimension for width to ensure enough space when rotated
-    tmpSprite_->createSprite(maxDimension, y_step);
+bool Face::addAccessory(Drawable *drawable, BoundingRect position,
+                        FaceLayer layer) {
+  if (accessoryCount_ >= kMaxAccessories) {
+    return false;
   }
+  accessories_[accessoryCount_++] = {drawable, position, layer};
+  revision_++;
+  return true;
+}
 
-  // 背景クリア用の色を設定
-  tmpSprite_->setBaseColor(ctx->getColorPalette()->get(COLOR_BACKGROUND));
-  int y = 0;
-  do {
-    // 背景色で塗り潰し
-    tmpSprite_->clear();
+void Face::removeAccessory(Drawable *drawable) {
+  int count = 0;
+  for (int i = 0; i < accessoryCount_; i++) {
+    if (accessories_[i].drawable != drawable) {
+      accessories_[count++] = accessories_[i];
+    }
+  }
+  if (count != accessoryCount_) {
+    accessoryCount_ = count;
+    revision_++;
+  }
+}
 
-    // 傾きとズームを反映してspriteからtmpSpriteに転写
-    // Use maxDimension/2 as the center of rotation to avoid memory access issues
-    sprite_->pushRotateZoom(tmpSprite_, maxDimension>>1, (maxDimension>>1) - y, rotation, scale, scale);
+void Face::setLayerBuffered(FaceLayer layer, bool buffered) {
+  if (layers_[static_cast<int>(layer)].buffered != buffered) {
+    layers_[static_cast<int>(layer)].buffered = buffered;
+    revision_++;
+  }
+}
+
+bool Face::isLayerBuffered(FaceLayer layer) const {
+  return layers_[static_cast<int>(layer)].buffered;
+}
 
-    // tmpSpriteから画面に転写
-    display->startWrite();
+void Face::invalidateLayer(FaceLayer layer) {
+  layers_[static_cast<int>(layer)].invalid = true;
+  revision_++;
+}
 
-    // 事前にstartWriteしておくことで、pushSprite はDMA転送を開始するとすぐに処理を終えて戻ってくる。
-    // Calculate offsets to center the content in the square canvas
-    int offsetX = boundingRect_->getLeft() + (maxDimension - boundingRect_->getWidth()) / 2;
-    int offsetY = boundingRect_->getTop() + (maxDimension - boundingRect_->getHeight()) / 2 + y;
-    tmpSprite_->pushSprite(display, offsetX, offsetY);
+bool Face::draw(DrawContext *ctx) {
+  if (!prepareCanvas(ctx)) {
+    return false;
+  }
+  if (renderMode_ == RenderMode::Strips &&
+      ctx->getColorDepth() != canvasDepth_) {
+    // the parts are recorded at the depth of the strips, with a palette of
+    // the face so the caller's stays resolved for its own depth
+    framePalette_ = *ctx->getColorPalette();
+    DrawContext frameCtx(
+        ctx->getExpression(), ctx->getBreath(), &framePalette_,
+        ctx->getRightGaze(), ctx->getRightEyeOpenRatio(), ctx->getLeftGaze(),
+        ctx->getLeftEyeOpenRatio(), ctx->getMouthOpenRatio(),
+        ctx->getSpeechText(), ctx->getRotation(), ctx->getScale(),
+        canvasDepth_, ctx->getBatteryIconStatus(), ctx->getBatteryLevel(),
+        ctx->getSpeechFont());
+    frameCtx.setSpeechLayout(ctx->getSpeechLayout(), ctx->getSpeechScroll());
+    if (ctx->hasPosition()) {
+      frameCtx.setPosition(ctx->getTop(), ctx->getLeft());
+    }
+    return drawFrame(&frameCtx);
+  }
+  return drawFrame(ctx);
+}
 
-    // DMA転送中にdelay処理を設けることにより、DMA転送中に他のタスクへCPU処理時間を譲ることができる。
-    lgfx::delay(1);
+bool Face::drawFrame(DrawContext *ctx) {
+  prepareLayers();
+  // Get the display from the sprite
+  lgfx::LovyanGFX *display = sprite_->getParent();
 
-    // endWriteによってDMA転送の終了を待つ。
-    display->endWrite();
+  float breath = _min(1.0f, ctx->getBreath());
+  // TODO(meganetaaan): rethink responsibility for transform function
+  float scale = ctx->getScale();
+  float rotation = ctx->getRotation();
 
-  } while ((y += y_step) < boundingRect_->getHeight());
+  // TODO(meganetaaan): make balloons and effects selectable
+  Drawable *builtins[kPartCount] = {mouth_,    eyeR_, eyeL_, eyeblowR_,
+                                    eyeblowL_, b_,    h_};
+  // the effect lays its marks out over the whole face
+  BoundingRect canvasRect(0, 0, canvasWidth_, canvasHeight_);
+  BoundingRect *positions[kPartCount] = {mouthPos_,    eyeRPos_, eyeLPos_,
+                                         eyeblowRPos_, eyeblowLPos_, &br,
+                                         &canvasRect};
+  FrameParts frame;
+  uint32_t keys[kSlotCount];
+  accessoryFrame_++;
+  for (int i = 0; i < kSlotCount; i++) {
+    if (i < kPartCount) {
+      frame.parts[i] = builtins[i];
+      frame.layers[i] = kPartLayers[i];
+      frame.rects[i] = *positions[i];
+      if (i < kBalloon) {
+        frame.rects[i].setPosition(frame.rects[i].getTop() + breath * 3,
+                                   frame.rects[i].getLeft());
+      }
+    } else if (i - kPartCount < accessoryCount_) {
+      Accessory &accessory = accessories_[i - kPartCount];
+      frame.parts[i] = accessory.drawable;
+      frame.layers[i] = accessory.layer;
+      frame.rects[i] = accessory.position;
+    } else {
+      // an empty slot
+      frame.parts[i] = nullptr;
+      frame.regions[i] = BoundingRect(0, 0, 0, 0);
+      frame.regionKnown[i] = true;
+      frame.recorded[i] = false;
+      keys[i] = 0;
+      continue;
+    }
+    frame.recorded[i] = recording_ || renderMode_ == RenderMode::Strips;
+    if (frame.recorded[i]) {
+      // what the part draws tells exactly whether and where it changed
+      recordPart(i, frame, ctx);
+      frame.regionKnown[i] = true;
+      frame.regions[i] = lists_[i].getBounds();
+      keys[i] = lists_[i].getHash();
+      continue;
+    }
+    frame.regionKnown[i] =
+        frame.parts[i]->getRegion(frame.rects[i], ctx, &frame.regions[i]);
+    keys[i] = getPartKey(i, frame.rects[i], ctx);
+    if (i >= kPartCount && frame.layers[i] != FaceLayer::Static) {
+      // animated accessories are drawn every frame
+      keys[i] ^= accessoryFrame_;
+    }
+  }
 
-// 削除するのが良いかどうか要検討 (次回メモリ確保できない場合は描画できなくなるので、維持しておいても良いかも？)
-// tmpSprite_->deleteSprite();
-// ▲▲▲▲ここまで▲▲▲▲
+  // collect the regions of the parts that changed since the last frame, per
+  // layer
+  uint32_t frameKey = getFrameKey(ctx);
+  bool full = !hasLastFrame_ || frameKey != lastFrameKey_;
+  for (int l = 0; l < kFaceLayerCount; l++) {
+    layers_[l].dirty =
+        layers_[l].invalid ? canvasRect : BoundingRect(0, 0, 0, 0);
+  }
+  for (int i = 0; i < kSlotCount && !full; i++) {
+    if (keys[i] == lastPartKeys_[i] &&
+        frame.regionKnown[i] == lastRegionKnown_[i] &&
+        frame.regions[i] == lastRegions_[i]) {
+      continue;
+    }
+    if (!frame.regionKnown[i] || !lastRegionKnown_[i]) {
+      full = true;
+      break;
+    }
+    // an emptied slot has no layer, its old region is cleared at the bottom
+    Layer &layer = layers_[frame.parts[i] != nullptr
+                               ? static_cast<int>(frame.layers[i])
+                               : 0];
+    layer.dirty.unite(frame.regions[i]);
+    layer.dirty.unite(lastRegions_[i]);
+  }
+  // the face under a battery icon that went away or moved is pushed again
+  BoundingRect hudRect = getHudRect(ctx, display);
+  if (!full && hasLastFrame_ && hudRect != lastHudRect_) {
+    layers_[0].dirty.unite(toCanvasArea(lastHudRect_, ctx));
+  }
+  frame.full = full;
+  BoundingRect dirty(0, 0, 0, 0);
+  for (int l = 0; l < kFaceLayerCount; l++) {
+    if (full) {
+      layers_[l].dirty = canvasRect;
+    }
+    dirty.unite(layers_[l].dirty);
+    layers_[l].invalid = false;
+  }
+  if (!dirty.intersects(canvasRect)) {
+    dirty = BoundingRect(0, 0, 0, 0);
+  }
 
-  sprite_->deleteSprite();
+  // the battery icon is drawn over the face in the strips, so every display
+  // pixel under it is written once per frame
+  bool hudChanged = battery_->update(ctx, canvasDepth_);
+  M5Canvas *hud = hudRect.isEmpty() ? nullptr : battery_->getSprite();
+  BoundingRect bounds = toOutputArea(canvasRect, ctx, display);
+  BoundingRect area(0, 0, 0, 0);
+  if (!dirty.isEmpty()) {
+    {
+      M5AVATAR_PROBE(stats_, FramePhase::Parts);
+      // bring the buffered layers up to date where they or the layers below
+      // changed, each one starting from the buffer below it
+      BoundingRect changed(0, 0, 0, 0);
+      int base = -1;
+      for (int l = 0; l < kFaceLayerCount; l++) {
+        changed.unite(layers_[l].dirty);
+        M5Canvas *buffer = getLayerBuffer(l);
+        if (buffer == nullptr) {
+          continue;
+        }
+        composeLayers(buffer, changed, base, l, frame, ctx);
+        base = l;
+      }
+      // the canvas takes the top buffer and the layers above it
+      if (renderMode_ == RenderMode::Canvas) {
+        composeLayers(sprite_, dirty, base, kFaceLayerCount - 1, frame, ctx);
+      }
+    }
+
+    // only the strips inside the display are resampled and pushed
+    area = bounds;
+    if (!full) {
+      area = toOutputArea(dirty, ctx, display);
+    } else if (hasLastFrame_) {
+      // clear what the last frame covered outside of the new bounds
+      area.unite(lastBounds_);
+      area.unite(lastHudRect_);
+    }
+  }
+  if (hud != nullptr &&
+      (hudChanged || hudRect != lastHudRect_ || !hasLastFrame_)) {
+    area.unite(hudRect);
+  }
+  if (!area.isEmpty()) {
+    if (!strips_.prepare(display, area.getWidth())) {
+      hasLastFrame_ = false;
+      return false;
+    }
+    BoundingRect frameRect = getFrameRect(ctx);
+    StripSource source = {
+        sprite_,
+        rotation,
+        scale,
+        blitMode_,
+        ctx->getColorPalette()->get(ColorKey::Primary),
+        ctx->getColorPalette()->get(ColorKey::Background),
+        frameRect.getLeft() + canvasWidth_ / 2.0f,
+        frameRect.getTop() + canvasHeight_ / 2.0f,
+        nullptr,
+        hud,
+        hudRect.getLeft(),
+        hudRect.getTop()};
+    if (renderMode_ == RenderMode::Strips) {
+      // every strip replays the lists, layer by layer
+      listRenderer_.reset(canvasWidth_, canvasHeight_);
+      for (int l = 0; l < kFaceLayerCount; l++) {
+        for (int i = 0; i < kSlotCount; i++) {
+          if (frame.parts[i] != nullptr &&
+              static_cast<int>(frame.layers[i]) == l) {
+            listRenderer_.add(&lists_[i]);
+          }
+        }
+      }
+      source.canvas = nullptr;
+      source.renderer = &listRenderer_;
+    }
+    strips_.push(display, source, area);
+  }
+  if (!dirty.isEmpty()) {
+    lastBounds_ = bounds;
+  }
+  lastHudRect_ = hudRect;
+
+  hasLastFrame_ = true;
+  lastFrameKey_ = frameKey;
+  for (int i = 0; i < kSlotCount; i++) {
+    lastPartKeys_[i] = keys[i];
+    lastRegions_[i] = frame.regions[i];
+    lastRegionKnown_[i] = frame.regionKnown[i];
+  }
+  return true;
 }
 }  // namespace m5avatar
\ No newline at end of file
@@ -5,6 +5,7 @@
 #ifndef FACE_H_
 #define FACE_H_
 
+#include "Accessory.h"
 #include "Balloon.h"
 #include "BoundingRect.h"
 #include "Eye.h"
@@ -12,9 +13,24 @@
 #include "Mouth.h"
 #include "Effect.h"
 #include "BatteryIcon.h"
+#include "DisplayList.h"
+#include "Fingerprint.h"
+#include "FrameStats.h"
+#include "StripPipeline.h"
 
 namespace m5avatar {
 
+/**
+ * Where the face is drawn before it is pushed
+ */
+enum class RenderMode {
+  // a canvas of the whole face, transformed while the strips are filled
+  Canvas,
+  // no canvas: the parts are recorded every frame and the lists replayed
+  // into each strip, so drawing takes memory for the strips only
+  Strips
+};
+
 class Face {
  private:
   Drawable *mouth_;
@@ -29,29 +45,117 @@ class Face {
   BoundingRect *eyeblowLPos_;
   BoundingRect *boundingRect_;
   M5Canvas *sprite_;
-  M5Canvas *tmpSprite_;
+  StripPipeline strips_;
+  FrameStats *stats_;
   Balloon *b_;
   Effect *h_;
   BatteryIcon *battery_;
+  // parts of the default layout, which resize() lays out again
+  Drawable *layoutParts_[5];
+
+  // geometry of the buffer currently held by sprite_
+  int16_t canvasWidth_;
+  int16_t canvasHeight_;
+  int canvasDepth_;
+  BlitMode blitMode_;
+
+  // the built-in parts come first in the per-frame arrays, then the
+  // accessories
+  static constexpr int kPartCount = 7;
+  static constexpr int kMaxAccessories = 4;
+  static constexpr int kSlotCount = kPartCount + kMaxAccessories;
+  Accessory accessories_[kMaxAccessories];
+  uint8_t accessoryCount_;
+  // changes every frame, redraws the accessories of the animated layers
+  uint32_t accessoryFrame_;
+  // see getRevision()
+  uint32_t revision_;
+
+  struct Layer {
+    // redraw the whole layer on the next draw
+    bool invalid = false;
+    // where the layer changed this frame
+    BoundingRect dirty;
+    // keep the layers up to this one composed in buffer
+    bool buffered = false;
+    M5Canvas buffer;
+  };
+  Layer layers_[kFaceLayerCount];
+
+  // what each slot drew this frame, while recording
+  bool recording_;
+  RecordingCanvas recorder_;
+  DisplayList lists_[kSlotCount];
+  RenderMode renderMode_;
+  DisplayListRenderer listRenderer_;
+  // a copy of the caller's palette, resolved for the strips of this frame
+  ColorPalette framePalette_;
+
+  // the parts of one frame, with nullptr for empty slots
+  struct FrameParts {
+    Drawable *parts[kSlotCount];
+    FaceLayer layers[kSlotCount];
+    BoundingRect rects[kSlotCount];
+    BoundingRect regions[kSlotCount];
+    bool regionKnown[kSlotCount];
+    // drawn from lists_ instead of the part
+    bool recorded[kSlotCount];
+    bool full;
+  };
+
+  // inputs of the last pushed frame, used to push only the parts that changed
+  bool hasLastFrame_;
+  uint32_t lastFrameKey_;
+  uint32_t lastPartKeys_[kSlotCount];
+  BoundingRect lastRegions_[kSlotCount];
+  bool lastRegionKnown_[kSlotCount];
+  // display area covered by the last frame
+  BoundingRect lastBounds_;
+  // display area of the battery icon in the last frame, empty if hidden
+  BoundingRect lastHudRect_;
+
+  bool prepareCanvas(DrawContext *ctx);
+  // draw() once the canvas is ready, with the context the parts draw with
+  bool drawFrame(DrawContext *ctx);
+  // where the canvas goes on the display this frame, from the context
+  BoundingRect getFrameRect(DrawContext *ctx);
+  uint32_t getFrameKey(DrawContext *ctx);
+  uint32_t getPartKey(int index, BoundingRect rect, DrawContext *ctx);
+  BoundingRect toOutputArea(BoundingRect region, DrawContext *ctx,
+                            lgfx::LovyanGFX *display);
+  BoundingRect toCanvasArea(BoundingRect area, DrawContext *ctx);
+  BoundingRect getHudRect(DrawContext *ctx, lgfx::LovyanGFX *display);
+  void prepareLayers();
+  M5Canvas *getLayerBuffer(int layer);
+  // draw the layers base + 1 to top over the buffer of base (-1 for none)
+  // into the region of target
+  void recordPart(int index, const FrameParts &frame, DrawContext *ctx);
+  void composeLayers(M5Canvas *target, BoundingRect region, int base, int top,
+                     const FrameParts &frame, DrawContext *ctx);
 
  public:
   // constructor
-  Face(M5GFX* display = &M5.Display);
+  // width and height of 0 take the size of the display. The display reports
+  // 0 until M5.begin(), and the 320x240 layout is used then.
+  Face(lgfx::LovyanGFX *display = &M5.Display, int16_t width = 0,
+       int16_t height = 0);
   Face(Drawable *mouth, Drawable *eyeR, Drawable *eyeL, Drawable *eyeblowR,
-       Drawable *eyeblowL, M5GFX* display);
+       Drawable *eyeblowL, lgfx::LovyanGFX *display, int16_t width = 0,
+       int16_t height = 0);
   // TODO(meganetaaan): apply builder pattern
   Face(Drawable *mouth, BoundingRect *mouthPos, Drawable *eyeR,
        BoundingRect *eyeRPos, Drawable *eyeL, BoundingRect *eyeLPos,
        Drawable *eyeblowR, BoundingRect *eyeblowRPos, Drawable *eyeblowL,
-       BoundingRect *eyeblowLPos, M5GFX* display);
+       BoundingRect *eyeblowLPos, lgfx::LovyanGFX *display = &M5.Display,
+       int16_t width = 0, int16_t height = 0);
   Face(Drawable *mouth, BoundingRect *mouthPos, Drawable *eyeR,
        BoundingRect *eyeRPos, Drawable *eyeL, BoundingRect *eyeLPos,
        Drawable *eyeblowR, BoundingRect *eyeblowRPos, Drawable *eyeblowL,
        BoundingRect *eyeblowLPos,
        BoundingRect *boundingRect, M5Canvas *spr, M5Canvas *tmpSpr);
   ~Face();
-  Face(const Face &other) = default;
-  Face &operator=(const Face &other) = default;
+  Face(const Face &other) = delete;
+  Face &operator=(const Face &other) = delete;
 
   Drawable *getLeftEye();
   Drawable *getRightEye();
@@ -60,16 +164,123 @@ class Face {
   // Drawable *getParts(PartsType p);
 
   Drawable *getMouth();
+  Balloon *getBalloon();
   BoundingRect *getBoundingRect();
   void setBoundingRect(BoundingRect *rect);
 
+  /**
+   * @brief Change the size of the face, keeping its position
+   *
+   * The part and accessory positions are scaled to the new size, and the
+   * parts of the default layout still in place are sized for it. No part is
+   * replaced, so pointers to them stay valid.
+   */
+  void resize(int16_t width, int16_t height);
+
   void setLeftEye(Drawable *eye);
   void setRightEye(Drawable *eye);
   void setMouth(Drawable *mouth);
   void setLeftEyeblow();
   void setRightEyeblow();
 
-  void draw(DrawContext *ctx);
+  // redraw and push the whole face on the next draw
+  void invalidate();
+  /**
+   * @brief A counter changed by every setter of the face
+   *
+   * The face's own settings are not inputs of the frame, so Avatar adds
+   * this to the inputs it compares to skip unchanged frames.
+   */
+  uint32_t getRevision() const;
+  // whether an accessory is on a layer drawn every frame
+  bool isAnimated() const;
+
+  /**
+   * @brief Add a drawable to a layer of the face, drawn after its parts
+   *
+   * @return false if there are already kMaxAccessories
+   */
+  bool addAccessory(Drawable *drawable, BoundingRect position,
+                    FaceLayer layer);
+  void removeAccessory(Drawable *drawable);
+
+  // keep the layers up to this one composed in a buffer of the canvas size,
+  // so that changes above it start from the buffer instead of redrawing
+  // the parts below. Off by default.
+  void setLayerBuffered(FaceLayer layer, bool buffered);
+  bool isLayerBuffered(FaceLayer layer) const;
+  // redraw the whole layer and the layers above it on the next draw
+  void invalidateLayer(FaceLayer layer);
+
+  /**
+   * @brief Record what the parts draw into display lists, off by default
+   *
+   * Every part is drawn into a RecordingCanvas each frame.
+   * Comparing the lists with the last frame's tells which parts changed and
+   * where, even for parts that cannot tell their region, and the canvas is
+   * drawn by replaying the lists.
+   */
+  void setRecording(bool recording);
+  bool isRecording() const;
+
+  /**
+   * @brief Draw with or without a canvas of the whole face
+   *
+   * RenderMode::Strips is for boards without PSRAM, where the canvas does
+   * not fit: the parts are recorded (see setRecording) at the display's
+   * color depth and the lists replayed into each strip. Drawing memory is
+   * the strip buffers, 2 * threads * width * strip height pixels at the
+   * display's depth, plus the lists, which grow with what the parts draw
+   * (12 bytes a rect). Layer buffers are not used, and the parts draw at
+   * the display's color depth with a copy of the context's palette, which
+   * is left as it is.
+   */
+  void setRenderMode(RenderMode mode);
+  RenderMode getRenderMode() const;
+
+  void setBlitMode(BlitMode mode);
+  BlitMode getBlitMode() const;
+
+  // rows of each strip pushed to the display, 8 by default. Taller strips
+  // mean fewer transfers at the cost of two larger buffers.
+  void setStripHeight(uint8_t rows);
+  uint8_t getStripHeight() const;
+
+  // threads resampling the strips, 1 by default. 2 splits the rotate/zoom
+  // stage between both cores on ESP32; the native build accepts up to 4.
+  void setStripThreadCount(uint8_t threads);
+  uint8_t getStripThreadCount() const;
+
+  // where the phase times go, see M5AVATAR_FRAME_STATS
+  void setFrameStats(FrameStats *stats);
+
+  /**
+   * @brief Draw the face to the display
+   *
+   * The face is drawn untransformed into a canvas of the bounding rect's
+   * size, then rotated and scaled around its center while the strips are
+   * resampled; only the strips inside the display are pushed. The rotation,
+   * the scale and the position (see DrawContext::setPosition) are the
+   * context's, so a frame uses one transform throughout.
+   *
+   * The frame canvas and the strip buffers are kept across frames and only
+   * reallocated when the bounding rect, the color depth or the display's
+   * color depth changes. While the transform, the palette and the position
+   * stay the same, only the regions of the parts that changed since the last
+   * frame are cleared, redrawn and pushed.
+   *
+   * The parts are composed in layers (see FaceLayer). A region that changed
+   * in a layer is composed from the buffer of the highest buffered layer
+   * below it, if any, so the parts under that buffer are not drawn again.
+   *
+   * The battery icon is not part of the canvas: it stays upright at the top
+   * right corner of the bounding rect and is drawn from its own sprite into
+   * the strips over the face, so a battery update alone pushes only the
+   * strips under the icon.
+   *
+   * @return false if the buffers could not be allocated (nothing is drawn)
+   */
+  bool draw(DrawContext *ctx);
 };
 }  // namespace m5avatar
 
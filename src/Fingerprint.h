@@ -0,0 +1,53 @@
+// Copyright (c) Shinya Ishikawa. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full
+// license information.
+
+#ifndef FINGERPRINT_H_
+#define FINGERPRINT_H_
+#include <stddef.h>
+#include <stdint.h>
+
+namespace m5avatar {
+/**
+ * Cheap FNV-1a hash used to detect changes of drawing inputs between frames
+ */
+class Fingerprint {
+ private:
+  uint32_t hash_ = 2166136261u;
+
+ public:
+  Fingerprint() = default;
+  ~Fingerprint() = default;
+  Fingerprint(const Fingerprint &other) = default;
+  Fingerprint &operator=(const Fingerprint &other) = default;
+
+  Fingerprint &add(const void *data, size_t length) {
+    const uint8_t *bytes = static_cast<const uint8_t *>(data);
+    for (size_t i = 0; i < length; i++) {
+      hash_ = (hash_ ^ bytes[i]) * 16777619u;
+    }
+    return *this;
+  }
+
+  Fingerprint &add(const char *text) {
+    if (text == nullptr) {
+      return add(&text, sizeof(text));
+    }
+    while (*text) {
+      hash_ = (hash_ ^ static_cast<uint8_t>(*text++)) * 16777619u;
+    }
+    // terminate so that "ab"+"c" and "a"+"bc" differ
+    hash_ = hash_ * 16777619u;
+    return *this;
+  }
+
+  template <typename T>
+  Fingerprint &add(const T &value) {
+    return add(&value, sizeof(T));
+  }
+
+  uint32_t get() const { return hash_; }
+};
+}  // namespace m5avatar
+
+#endif  // FINGERPRINT_H_
@@ -0,0 +1,74 @@
+// Copyright (c) Shinya Ishikawa. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full
+// license information.
+
+#include "FrameStats.h"
+
+#include <algorithm>
+
+namespace m5avatar {
+
+FrameStats::FrameStats() : budgetUs_{33000} { reset(); }
+
+void FrameStats::setFrameBudget(uint32_t us) { budgetUs_ = us; }
+
+uint32_t FrameStats::getFrameBudget() const { return budgetUs_; }
+
+void FrameStats::beginFrame() {
+  std::fill(current_, current_ + kPhaseCount, 0);
+  frameStart_ = lgfx::micros();
+}
+
+void FrameStats::add(FramePhase phase, uint32_t us) {
+  current_[static_cast<int>(phase)] += us;
+}
+
+void FrameStats::endFrame(bool presented) {
+  uint32_t total = lgfx::micros() - frameStart_;
+  current_[static_cast<int>(FramePhase::Total)] = total;
+  for (int i = 0; i < kPhaseCount; i++) {
+    samples_[i][next_] = current_[i];
+  }
+  next_ = (next_ + 1) % kWindow;
+  count_ = std::min(count_ + 1, kWindow);
+  if (presented) {
+    renderedFrames_++;
+  }
+  if (!presented || total > budgetUs_) {
+    droppedFrames_++;
+  }
+}
+
+void FrameStats::reset() {
+  std::fill(current_, current_ + kPhaseCount, 0);
+  frameStart_ = 0;
+  count_ = 0;
+  next_ = 0;
+  renderedFrames_ = 0;
+  droppedFrames_ = 0;
+}
+
+PhaseStats FrameStats::get(FramePhase phase) const {
+  PhaseStats stats = {0, 0, 0};
+  if (count_ == 0) {
+    return stats;
+  }
+  uint32_t sorted[kWindow];
+  const uint32_t *samples = samples_[static_cast<int>(phase)];
+  std::copy(samples, samples + count_, sorted);
+  std::sort(sorted, sorted + count_);
+  uint64_t sum = 0;
+  for (int i = 0; i < count_; i++) {
+    sum += sorted[i];
+  }
+  stats.minUs = sorted[0];
+  stats.meanUs = sum / count_;
+  stats.p99Us = sorted[(count_ - 1) * 99 / 100];
+  return stats;
+}
+
+uint32_t FrameStats::getRenderedFrames() const { return renderedFrames_; }
+
+uint32_t FrameStats::getDroppedFrames() const { return droppedFrames_; }
+
+}  // namespace m5avatar
@@ -0,0 +1,119 @@
+// Copyright (c) Shinya Ishikawa. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full
+// license information.
+
+#ifndef FRAMESTATS_H_
+#define FRAMESTATS_H_
+#define LGFX_USE_V1
+#include <M5GFX.h>
+
+namespace m5avatar {
+
+/**
+ * Phases of a frame measured by FrameStats
+ */
+enum class FramePhase {
+  // taking the avatar's state and checking whether it changed
+  Context,
+  // clearing and drawing the parts into the face canvas
+  Parts,
+  // transferring the canvas into the strips (copy or rotate/zoom)
+  Resample,
+  // pushing the strips and waiting for the DMA transfers
+  Transfer,
+  // the whole Avatar::draw
+  Total
+};
+
+struct PhaseStats {
+  uint32_t minUs;
+  uint32_t meanUs;
+  uint32_t p99Us;
+};
+
+/**
+ * Rolling timing statistics of the last frames, per phase
+ *
+ * Filled by the probes in Avatar::draw, Face::draw and StripPipeline when
+ * the library is built with M5AVATAR_FRAME_STATS defined. Without it the
+ * probes compile to nothing and Avatar::getFrameStats() returns nullptr.
+ */
+class FrameStats {
+ public:
+  static constexpr int kPhaseCount = 5;
+  // number of frames the statistics are computed over
+  static constexpr int kWindow = 128;
+
+ private:
+  uint32_t samples_[kPhaseCount][kWindow];
+  uint32_t current_[kPhaseCount];
+  uint32_t frameStart_;
+  uint32_t budgetUs_;
+  int count_;
+  int next_;
+  uint32_t renderedFrames_;
+  uint32_t droppedFrames_;
+
+ public:
+  FrameStats();
+
+  // a frame longer than this is counted as dropped, 33ms (30fps) by default
+  void setFrameBudget(uint32_t us);
+  uint32_t getFrameBudget() const;
+
+  void beginFrame();
+  void add(FramePhase phase, uint32_t us);
+  // presented is false if the frame could not be drawn
+  void endFrame(bool presented);
+  void reset();
+
+  PhaseStats get(FramePhase phase) const;
+  // frames drawn to the display, including the late ones
+  uint32_t getRenderedFrames() const;
+  // frames that failed or took longer than the budget
+  uint32_t getDroppedFrames() const;
+};
+
+/**
+ * Adds the time until it goes out of scope to a phase of the current frame
+ */
+class PhaseProbe {
+ private:
+  FrameStats *stats_;
+  FramePhase phase_;
+  uint32_t start_;
+
+ public:
+  PhaseProbe(FrameStats *stats, FramePhase phase)
+      : stats_(stats), phase_(phase), start_(lgfx::micros()) {}
+  ~PhaseProbe() { stop(); }
+  // add the time until now and stop
+  void stop() {
+    if (stats_ != nullptr) {
+      stats_->add(phase_, lgfx::micros() - start_);
+      stats_ = nullptr;
+    }
+  }
+  PhaseProbe(const PhaseProbe &other) = delete;
+  PhaseProbe &operator=(const PhaseProbe &other) = delete;
+};
+
+}  // namespace m5avatar
+
+#define M5AVATAR_PROBE_NAME_(line) phaseProbe##line
+#define M5AVATAR_PROBE_NAME(line) M5AVATAR_PROBE_NAME_(line)
+#ifdef M5AVATAR_FRAME_STATS
+// time the rest of the enclosing scope as a phase of the frame
+#define M5AVATAR_PROBE(stats, phase) \
+  m5avatar::PhaseProbe M5AVATAR_PROBE_NAME(__LINE__)(stats, phase)
+// time a phase of the frame until M5AVATAR_PROBE_STOP(name)
+#define M5AVATAR_PROBE_START(name, stats, phase) \
+  m5avatar::PhaseProbe name(stats, phase)
+#define M5AVATAR_PROBE_STOP(name) name.stop()
+#else
+#define M5AVATAR_PROBE(stats, phase) ((void)0)
+#define M5AVATAR_PROBE_START(name, stats, phase) ((void)0)
+#define M5AVATAR_PROBE_STOP(name) ((void)0)
+#endif
+
+#endif  // FRAMESTATS_H_
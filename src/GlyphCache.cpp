@@ -0,0 +1,172 @@
+// Copyright (c) Shinya Ishikawa. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full
+// license information.
+
+#include "GlyphCache.h"
+
+#include "Fingerprint.h"
+
+namespace m5avatar {
+namespace {
+
+// write the codepoint as UTF-8 and terminate it, buffer holds 5 bytes
+void encodeUtf8(uint32_t codepoint, char *buffer) {
+  if (codepoint < 0x80) {
+    *buffer++ = codepoint;
+  } else if (codepoint < 0x800) {
+    *buffer++ = 0xC0 | codepoint >> 6;
+    *buffer++ = 0x80 | (codepoint & 0x3F);
+  } else if (codepoint < 0x10000) {
+    *buffer++ = 0xE0 | codepoint >> 12;
+    *buffer++ = 0x80 | (codepoint >> 6 & 0x3F);
+    *buffer++ = 0x80 | (codepoint & 0x3F);
+  } else {
+    *buffer++ = 0xF0 | codepoint >> 18;
+    *buffer++ = 0x80 | (codepoint >> 12 & 0x3F);
+    *buffer++ = 0x80 | (codepoint >> 6 & 0x3F);
+    *buffer++ = 0x80 | (codepoint & 0x3F);
+  }
+  *buffer = '\0';
+}
+
+}  // namespace
+
+uint32_t decodeUtf8(const char **text) {
+  const uint8_t *s = reinterpret_cast<const uint8_t *>(*text);
+  int length = 1;
+  uint32_t codepoint = s[0];
+  if ((s[0] & 0xE0) == 0xC0) {
+    length = 2;
+    codepoint = s[0] & 0x1F;
+  } else if ((s[0] & 0xF0) == 0xE0) {
+    length = 3;
+    codepoint = s[0] & 0x0F;
+  } else if ((s[0] & 0xF8) == 0xF0) {
+    length = 4;
+    codepoint = s[0] & 0x07;
+  }
+  for (int i = 1; i < length; i++) {
+    if ((s[i] & 0xC0) != 0x80) {
+      // truncated sequence
+      *text += 1;
+      return s[0];
+    }
+    codepoint = codepoint << 6 | (s[i] & 0x3F);
+  }
+  *text += length;
+  return codepoint;
+}
+
+GlyphCache::GlyphCache(size_t budget)
+    : uncached_{0, 0, nullptr},
+      budget_{budget},
+      usage_{0},
+      hits_{0},
+      misses_{0} {
+  scratch_.setColorDepth(1);
+}
+
+GlyphCache::~GlyphCache() { clear(); }
+
+const Glyph *GlyphCache::get(const lgfx::IFont *font, float textSize,
+                             uint32_t codepoint) {
+  uint64_t key =
+      static_cast<uint64_t>(Fingerprint().add(font).add(textSize).get())
+          << 32 |
+      codepoint;
+  // the uncached glyph of the last call is no longer needed
+  free(uncached_.bitmap);
+  uncached_.bitmap = nullptr;
+  auto found = index_.find(key);
+  if (found != index_.end()) {
+    hits_++;
+    entries_.splice(entries_.begin(), entries_, found->second);
+    return &found->second->glyph;
+  }
+  misses_++;
+  Entry entry;
+  if (!rasterize(font, textSize, codepoint, &entry.glyph)) {
+    return nullptr;
+  }
+  entry.key = key;
+  entry.bytes = ((entry.glyph.width + 7) >> 3) * entry.glyph.height;
+  if (entry.bytes > budget_) {
+    // caching it would take the usage over the budget
+    uncached_ = entry.glyph;
+    return &uncached_;
+  }
+  evict(entry.bytes);
+  entries_.push_front(entry);
+  index_[key] = entries_.begin();
+  usage_ += entry.bytes;
+  return &entries_.front().glyph;
+}
+
+bool GlyphCache::rasterize(const lgfx::IFont *font, float textSize,
+                           uint32_t codepoint, Glyph *glyph) {
+  char text[5];
+  encodeUtf8(codepoint, text);
+  scratch_.setFont(font);
+  scratch_.setTextSize(textSize);
+  glyph->width = scratch_.textWidth(text);
+  glyph->height = scratch_.fontHeight();
+  glyph->bitmap = nullptr;
+  if (glyph->width <= 0 || glyph->height <= 0) {
+    glyph->width = std::max<int16_t>(glyph->width, 0);
+    return true;
+  }
+  if (scratch_.width() != glyph->width ||
+      scratch_.height() != glyph->height) {
+    scratch_.deleteSprite();
+    if (scratch_.createSprite(glyph->width, glyph->height) == nullptr) {
+      return false;
+    }
+  }
+  size_t bytes = ((glyph->width + 7) >> 3) * glyph->height;
+  glyph->bitmap = static_cast<uint8_t *>(malloc(bytes));
+  if (glyph->bitmap == nullptr) {
+    return false;
+  }
+  scratch_.fillSprite(0);
+  scratch_.setTextColor(1, 0);
+  scratch_.setTextDatum(TL_DATUM);
+  scratch_.drawString(text, 0, 0);
+  memcpy(glyph->bitmap, scratch_.getBuffer(), bytes);
+  return true;
+}
+
+void GlyphCache::evict(size_t bytes) {
+  while (!entries_.empty() && usage_ + bytes > budget_) {
+    Entry &last = entries_.back();
+    usage_ -= last.bytes;
+    free(last.glyph.bitmap);
+    index_.erase(last.key);
+    entries_.pop_back();
+  }
+}
+
+void GlyphCache::setBudget(size_t bytes) {
+  budget_ = bytes;
+  evict(0);
+}
+
+size_t GlyphCache::getBudget() const { return budget_; }
+
+size_t GlyphCache::getUsage() const { return usage_; }
+
+uint32_t GlyphCache::getHitCount() const { return hits_; }
+
+uint32_t GlyphCache::getMissCount() const { return misses_; }
+
+void GlyphCache::clear() {
+  for (Entry &entry : entries_) {
+    free(entry.glyph.bitmap);
+  }
+  entries_.clear();
+  index_.clear();
+  usage_ = 0;
+  free(uncached_.bitmap);
+  uncached_.bitmap = nullptr;
+}
+
+}  // namespace m5avatar
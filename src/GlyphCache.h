@@ -0,0 +1,94 @@
+// Copyright (c) Shinya Ishikawa. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full
+// license information.
+
+#ifndef GLYPHCACHE_H_
+#define GLYPHCACHE_H_
+#define LGFX_USE_V1
+#include <M5GFX.h>
+
+#include <list>
+#include <unordered_map>
+
+namespace m5avatar {
+/**
+ * @brief Decode the UTF-8 character at *text and advance past it
+ *
+ * Malformed bytes decode to themselves, one byte at a time.
+ */
+uint32_t decodeUtf8(const char **text);
+
+/**
+ * A glyph rasterized at one text size, 1 bit per pixel, most significant
+ * bit first, rows padded to whole bytes (the format of drawBitmap)
+ */
+struct Glyph {
+  // advance width, also the width of the bitmap
+  int16_t width;
+  int16_t height;
+  // nullptr for glyphs without pixels
+  uint8_t *bitmap;
+};
+
+/**
+ * @brief Glyph bitmaps of recently drawn characters
+ *
+ * Decoding a glyph of a large font (e.g. lgfxJapanGothic) from its tables is
+ * much slower than copying its bitmap, so glyphs are rasterized once per
+ * font, text size and codepoint and kept until the memory budget forces the
+ * least recently used ones out.
+ */
+class GlyphCache {
+ public:
+  static constexpr size_t kDefaultBudget = 16 * 1024;
+
+ private:
+  struct Entry {
+    uint64_t key;
+    Glyph glyph;
+    size_t bytes;
+  };
+  // most recently used first
+  std::list<Entry> entries_;
+  std::unordered_map<uint64_t, std::list<Entry>::iterator> index_;
+  // the last glyph larger than the whole budget, which is not cached
+  Glyph uncached_;
+  // the glyphs are drawn here before their pixels are copied
+  M5Canvas scratch_;
+  size_t budget_;
+  size_t usage_;
+  uint32_t hits_;
+  uint32_t misses_;
+
+  bool rasterize(const lgfx::IFont *font, float textSize, uint32_t codepoint,
+                 Glyph *glyph);
+  void evict(size_t bytes);
+
+ public:
+  explicit GlyphCache(size_t budget = kDefaultBudget);
+  ~GlyphCache();
+  GlyphCache(const GlyphCache &other) = delete;
+  GlyphCache &operator=(const GlyphCache &other) = delete;
+
+  /**
+   * @brief The glyph of the codepoint, rasterized if it is not cached
+   *
+   * The glyph is valid until the next call. A glyph larger than the budget
+   * is rasterized again on every call instead of being cached.
+   *
+   * @return nullptr if the glyph could not be rasterized
+   */
+  const Glyph *get(const lgfx::IFont *font, float textSize,
+                   uint32_t codepoint);
+  // bytes of glyph bitmaps to keep at most, evicting at once if over
+  void setBudget(size_t bytes);
+  size_t getBudget() const;
+  size_t getUsage() const;
+  uint32_t getHitCount() const;
+  uint32_t getMissCount() const;
+  void clear();
+};
+
+}  // namespace m5avatar
+
+#endif  // GLYPHCACHE_H_
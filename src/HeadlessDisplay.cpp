@@ -0,0 +1,59 @@
+// Copyright (c) Shinya Ishikawa. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full
+// license information.
+
+#include "HeadlessDisplay.h"
+
+#include <stdio.h>
+
+namespace m5avatar {
+
+HeadlessDisplay::HeadlessDisplay(int16_t width, int16_t height,
+                                 int colorDepth) {
+  // like a panel, only 16-bit and 24-bit are supported
+  setColorDepth(colorDepth == 24 ? 24 : 16);
+  if (createSprite(width, height) == nullptr) {
+    M5_LOGE("failed to allocate %dx%d framebuffer", width, height);
+  }
+}
+
+bool HeadlessDisplay::isReady() const { return getBuffer() != nullptr; }
+
+size_t HeadlessDisplay::getStride() const {
+  return width() * ((getColorDepth() & 0xFF) >> 3);
+}
+
+bool HeadlessDisplay::savePPM(const char *path) const {
+  const uint8_t *buffer = static_cast<const uint8_t *>(getBuffer());
+  if (buffer == nullptr) {
+    return false;
+  }
+  FILE *fp = fopen(path, "wb");
+  if (fp == nullptr) {
+    return false;
+  }
+  fprintf(fp, "P6\n%d %d\n255\n", width(), height());
+  bool ok = true;
+  uint8_t *row = new uint8_t[width() * 3];
+  for (int y = 0; y < height() && ok; y++) {
+    const uint8_t *src = buffer + y * getStride();
+    if ((getColorDepth() & 0xFF) == 24) {
+      // 24-bit sprites hold R, G, B bytes in this order already
+      memcpy(row, src, width() * 3);
+    } else {
+      // 16-bit sprites hold big-endian RGB565
+      for (int x = 0; x < width(); x++, src += 2) {
+        uint16_t c = src[0] << 8 | src[1];
+        uint8_t r = c >> 11, g = (c >> 5) & 0x3F, b = c & 0x1F;
+        row[x * 3] = r << 3 | r >> 2;
+        row[x * 3 + 1] = g << 2 | g >> 4;
+        row[x * 3 + 2] = b << 3 | b >> 2;
+      }
+    }
+    ok = fwrite(row, 3, width(), fp) == static_cast<size_t>(width());
+  }
+  delete[] row;
+  return fclose(fp) == 0 && ok;
+}
+
+}  // namespace m5avatar
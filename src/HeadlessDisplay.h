@@ -0,0 +1,41 @@
+// Copyright (c) Shinya Ishikawa. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full
+// license information.
+
+#ifndef HEADLESSDISPLAY_H_
+#define HEADLESSDISPLAY_H_
+#define LGFX_USE_V1
+#include <M5GFX.h>
+
+namespace m5avatar {
+
+/**
+ * An in-memory framebuffer to render avatars without a panel or a window
+ *
+ * Pass it where Face or Avatar take a display: the strips are pushed into
+ * its RGB565 (16-bit) or RGB888 (24-bit) buffer, so frames are rendered as
+ * fast as the CPU allows and can be read back or saved.
+ */
+class HeadlessDisplay : public M5Canvas {
+ public:
+  HeadlessDisplay(int16_t width, int16_t height, int colorDepth = 16);
+  HeadlessDisplay(const HeadlessDisplay &other) = delete;
+  HeadlessDisplay &operator=(const HeadlessDisplay &other) = delete;
+
+  // false if the framebuffer could not be allocated
+  bool isReady() const;
+
+  // bytes per row of getBuffer()
+  size_t getStride() const;
+
+  /**
+   * @brief Write the framebuffer as a binary PPM (P6) image
+   *
+   * @return false if the file could not be written
+   */
+  bool savePPM(const char *path) const;
+};
+
+}  // namespace m5avatar
+
+#endif  // HEADLESSDISPLAY_H_
@@ -18,7 +18,7 @@ Mouth::Mouth(uint16_t minWidth, uint16_t maxWidth, uint16_t minHeight,
       maxHeight{maxHeight} {}
 
 void Mouth::draw(M5Canvas *spi, BoundingRect rect, DrawContext *ctx) {
-  uint16_t primaryColor = ctx->getColorDepth() == 1 ? 1 : ctx->getColorPalette()->get(COLOR_PRIMARY);
+  uint16_t primaryColor = ctx->getColor(ColorKey::Primary);
   float breath = _min(1.0f, ctx->getBreath());
   float openRatio = ctx->getMouthOpenRatio();
   int h = minHeight + (maxHeight - minHeight) * openRatio;
@@ -28,4 +28,14 @@ void Mouth::draw(M5Canvas *spi, BoundingRect rect, DrawContext *ctx) {
   spi->fillRect(x, y, w, h, primaryColor);
 }
 
+bool Mouth::getRegion(BoundingRect rect, DrawContext *ctx,
+                      BoundingRect *region) {
+  // cover every open ratio; breath moves the mouth by up to 2px
+  int16_t w = std::max(minWidth, maxWidth);
+  int16_t h = std::max(minHeight, maxHeight);
+  *region = BoundingRect(rect.getTop() - h / 2 - 3, rect.getLeft() - w / 2 - 1,
+                         w + 2, h + 6);
+  return true;
+}
+
 }  // namespace m5avatar
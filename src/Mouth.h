@@ -28,6 +28,8 @@ class Mouth final : public Drawable {
         uint16_t maxHeight);
   void draw(M5Canvas *spi, BoundingRect rect,
             DrawContext *drawContext) override;
+  bool getRegion(BoundingRect rect, DrawContext *drawContext,
+                 BoundingRect *region) override;
 };
 
 }  // namespace m5avatar
@@ -14,21 +14,27 @@ BaseMouth::BaseMouth(uint16_t min_width, uint16_t max_width,
       max_height_{max_height} {}
 
 void BaseMouth::update(M5Canvas *canvas, BoundingRect rect, DrawContext *ctx) {
-    primary_color_ = ctx->getColorDepth() == 1
-                         ? 1
-                         : ctx->getColorPalette()->get(COLOR_PRIMARY);
-    background_color_ = ctx->getColorDepth() == 1
-                            ? ERACER_COLOR
-                            : ctx->getColorPalette()->get(COLOR_BACKGROUND);
-    secondary_color_ = ctx->getColorDepth() == 1
-                           ? 1
-                           : ctx->getColorPalette()->get(COLOR_SECONDARY);
+    primary_color_ = ctx->getColor(ColorKey::Primary);
+    background_color_ = ctx->getColor(ColorKey::Background);
+    secondary_color_ = ctx->getColor(ColorKey::Secondary);
     center_x_ = rect.getCenterX();
     center_y_ = rect.getCenterY();
     open_ratio_ = ctx->getMouthOpenRatio();
     breath_ = _min(1.0f, ctx->getBreath());
 }
 
+bool BaseMouth::getRegion(BoundingRect rect, DrawContext *ctx,
+                          BoundingRect *region) {
+    // cheeks are drawn 132 +- 24px beside the center, masks reach 1.5 times
+    // the mouth height above it
+    int16_t half_width = std::max(max_width_ / 2 + 2, 160);
+    int16_t top = rect.getCenterY() - max_height_ * 3 / 2 - 40;
+    int16_t bottom = rect.getCenterY() + max_height_ + 40;
+    *region = BoundingRect(top, rect.getCenterX() - half_width, half_width * 2,
+                           bottom - top);
+    return true;
+}
+
 void RectMouth::draw(M5Canvas *canvas, BoundingRect rect, DrawContext *ctx) {
     this->update(canvas, rect, ctx);  // update drawing cache
     int16_t h = min_height_ + (max_height_ - min_height_) * open_ratio_;
@@ -41,6 +41,8 @@ class BaseMouth : public Drawable {
               uint16_t max_height);
 
     void update(M5Canvas *canvas, BoundingRect rect, DrawContext *ctx);
+    // conservative region covering the mouth, its masks and the cheeks
+    bool getRegion(BoundingRect rect, DrawContext *ctx, BoundingRect *region);
 };
 
 class RectMouth : public BaseMouth {
@@ -0,0 +1,306 @@
+// Copyright (c) Shinya Ishikawa. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full
+// license information.
+
+#include "SpeechCanvas.h"
+
+#include <string.h>
+
+#include <algorithm>
+
+#include "Blitter.h"
+#include "Fingerprint.h"
+
+namespace m5avatar {
+namespace {
+// lines may break after these, CJK text has no spaces between words
+bool isBreakAfter(uint32_t codepoint) {
+  return codepoint == ' ' || codepoint >= 0x2E80;
+}
+}  // namespace
+
+SpeechCanvas::SpeechCanvas()
+    : sprite_{&canvases_[0]},
+      styleKey_{0},
+      rendered_{false},
+      lineGlyphs_{false},
+      text_{""},
+      penX_{0},
+      line_{0},
+      windowX_{0},
+      font_{nullptr},
+      textSize_{1},
+      primaryColor_{0},
+      backgroundColor_{0},
+      measureKey_{0},
+      measuredWidth_{0} {}
+
+M5Canvas *SpeechCanvas::getSprite() { return sprite_; }
+
+GlyphCache *SpeechCanvas::getGlyphCache() { return &glyphs_; }
+
+int16_t SpeechCanvas::measure(const char *text, const lgfx::IFont *font,
+                              float textSize) {
+  uint32_t key = Fingerprint().add(text).add(font).add(textSize).get();
+  if (key != measureKey_) {
+    sprite_->setFont(font);
+    sprite_->setTextSize(textSize);
+    size_t length = text_.length();
+    if (lineGlyphs_ && font == font_ && textSize == textSize_ &&
+        strncmp(text, text_.c_str(), length) == 0 &&
+        strlen(text) >= length) {
+      // only the text appended to the line is measured
+      measuredWidth_ = penX_ + sprite_->textWidth(text + length);
+    } else {
+      measuredWidth_ = sprite_->textWidth(text);
+    }
+    measureKey_ = key;
+  }
+  return measuredWidth_;
+}
+
+int16_t SpeechCanvas::getLineHeight(const lgfx::IFont *font, float textSize) {
+  sprite_->setFont(font);
+  sprite_->setTextSize(textSize);
+  return sprite_->fontHeight();
+}
+
+bool SpeechCanvas::update(const char *text, const lgfx::IFont *font,
+                          float textSize, SpeechLayout layout, int32_t scroll,
+                          int16_t width, int16_t lines, uint16_t primaryColor,
+                          uint16_t backgroundColor, int colorDepth) {
+  font_ = font;
+  textSize_ = textSize;
+  primaryColor_ = primaryColor;
+  backgroundColor_ = backgroundColor;
+  int16_t lineHeight = getLineHeight(font, textSize);
+  uint32_t styleKey = Fingerprint()
+                          .add(font)
+                          .add(textSize)
+                          .add(layout)
+                          .add(width)
+                          .add(lines)
+                          .add(primaryColor)
+                          .add(backgroundColor)
+                          .add(colorDepth)
+                          .get();
+  size_t length = text_.length();
+  bool appended = rendered_ && styleKey == styleKey_ &&
+                  strncmp(text, text_.c_str(), length) == 0 &&
+                  strlen(text) >= length;
+
+  if (layout == SpeechLayout::Line) {
+    if (appended && text[length] == '\0') {
+      return true;
+    }
+    // the sprite fits the text, it grows by the glyphs appended to it
+    int16_t textWidth = std::max<int16_t>(1, measure(text, font, textSize));
+    if (!appended || !lineGlyphs_ || !appendLine(text + length, textWidth)) {
+      if (!reset(textWidth, lineHeight, colorDepth) || !renderLine(text)) {
+        return false;
+      }
+      appended = false;
+    }
+  } else {
+    if (!appended) {
+      int16_t height = lineHeight * (layout == SpeechLayout::Wrap ? lines : 1);
+      if (!reset(width, height, colorDepth)) {
+        return false;
+      }
+      length = 0;
+    }
+    if (layout == SpeechLayout::Wrap) {
+      appendWrapped(text + length, lines);
+    } else {
+      appendTicker(text + length, scroll);
+    }
+  }
+  if (appended) {
+    text_ += text + length;
+  } else {
+    text_ = text;
+  }
+  styleKey_ = styleKey;
+  rendered_ = true;
+  return true;
+}
+
+bool SpeechCanvas::reset(int16_t width, int16_t height, int colorDepth) {
+  rendered_ = false;
+  lineGlyphs_ = false;
+  text_ = "";
+  placed_.clear();
+  penX_ = 0;
+  line_ = 0;
+  windowX_ = 0;
+  if (sprite_->getBuffer() == nullptr || sprite_->width() != width ||
+      sprite_->height() != height ||
+      (sprite_->getColorDepth() & 0xFF) != colorDepth) {
+    sprite_->deleteSprite();
+    sprite_->setColorDepth(colorDepth);
+    if (sprite_->createSprite(width, height) == nullptr) {
+      return false;
+    }
+  }
+  // scroll() fills what it uncovers with the base color
+  sprite_->setBaseColor(backgroundColor_);
+  sprite_->fillSprite(backgroundColor_);
+  return true;
+}
+
+void SpeechCanvas::drawGlyph(uint32_t codepoint, int32_t x, int32_t y) {
+  const Glyph *glyph = glyphs_.get(font_, textSize_, codepoint);
+  if (glyph != nullptr && glyph->bitmap != nullptr) {
+    sprite_->drawBitmap(x, y, glyph->bitmap, glyph->width, glyph->height,
+                        primaryColor_, backgroundColor_);
+  }
+}
+
+bool SpeechCanvas::renderLine(const char *text) {
+  int32_t x = 0;
+  for (const char *p = text; *p;) {
+    const Glyph *glyph = glyphs_.get(font_, textSize_, decodeUtf8(&p));
+    if (glyph == nullptr) {
+      // draw it as a whole instead
+      sprite_->fillSprite(backgroundColor_);
+      sprite_->setTextColor(primaryColor_, backgroundColor_);
+      sprite_->setTextDatum(MC_DATUM);
+      sprite_->drawString(text, sprite_->width() / 2, sprite_->height() / 2);
+      return true;
+    }
+    if (glyph->bitmap != nullptr) {
+      sprite_->drawBitmap(x, 0, glyph->bitmap, glyph->width, glyph->height,
+                          primaryColor_, backgroundColor_);
+    }
+    x += glyph->width;
+  }
+  penX_ = x;
+  lineGlyphs_ = true;
+  return true;
+}
+
+bool SpeechCanvas::appendLine(const char *text, int16_t width) {
+  // the line moves to the other canvas, made as wide as the new text
+  M5Canvas *grown = sprite_ == &canvases_[0] ? &canvases_[1] : &canvases_[0];
+  grown->setColorDepth(sprite_->getColorDepth());
+  if (grown->createSprite(width, sprite_->height()) == nullptr) {
+    return false;
+  }
+  int16_t oldWidth = sprite_->width();
+  copyToCanvas(sprite_, grown, 0, 0);
+  grown->setBaseColor(backgroundColor_);
+  grown->fillRect(oldWidth, 0, width - oldWidth, grown->height(),
+                  backgroundColor_);
+  sprite_->deleteSprite();
+  sprite_ = grown;
+  for (const char *p = text; *p;) {
+    const Glyph *glyph = glyphs_.get(font_, textSize_, decodeUtf8(&p));
+    if (glyph == nullptr) {
+      // the line is drawn as a whole instead
+      return false;
+    }
+    if (glyph->bitmap != nullptr) {
+      sprite_->drawBitmap(penX_, 0, glyph->bitmap, glyph->width,
+                          glyph->height, primaryColor_, backgroundColor_);
+    }
+    penX_ += glyph->width;
+  }
+  return true;
+}
+
+void SpeechCanvas::newLine(int16_t lines) {
+  penX_ = 0;
+  if (line_ + 1 < lines) {
+    line_++;
+  } else {
+    // the last line is full, move everything up by a line
+    sprite_->scroll(0, -(sprite_->height() / lines));
+  }
+}
+
+void SpeechCanvas::appendWrapped(const char *text, int16_t lines) {
+  int16_t lineHeight = sprite_->height() / lines;
+  int16_t width = sprite_->width();
+  while (*text) {
+    uint32_t codepoint = decodeUtf8(&text);
+    if (codepoint == '\n') {
+      newLine(lines);
+      placed_.clear();
+      continue;
+    }
+    const Glyph *glyph = glyphs_.get(font_, textSize_, codepoint);
+    int16_t glyphWidth = glyph != nullptr ? glyph->width : 0;
+    if (penX_ + glyphWidth > width && penX_ > 0) {
+      int32_t wordX = placed_.empty() ? penX_ : placed_.front().x;
+      if (wordX > 0 && penX_ - wordX + glyphWidth <= width) {
+        // carry the unfinished word over to the next line
+        sprite_->fillRect(wordX, line_ * lineHeight, penX_ - wordX,
+                          lineHeight, backgroundColor_);
+        newLine(lines);
+        for (Placed &placed : placed_) {
+          placed.x = penX_;
+          drawGlyph(placed.codepoint, penX_, line_ * lineHeight);
+          penX_ += placed.width;
+        }
+      } else {
+        newLine(lines);
+        placed_.clear();
+      }
+    }
+    drawGlyph(codepoint, penX_, line_ * lineHeight);
+    placed_.push_back({codepoint, penX_, glyphWidth});
+    penX_ += glyphWidth;
+    if (isBreakAfter(codepoint)) {
+      placed_.clear();
+    }
+  }
+}
+
+void SpeechCanvas::appendTicker(const char *text, int32_t scroll) {
+  int16_t width = sprite_->width();
+  int32_t oldEnd = penX_;
+  while (*text) {
+    uint32_t codepoint = decodeUtf8(&text);
+    const Glyph *glyph = glyphs_.get(font_, textSize_, codepoint);
+    int16_t glyphWidth = glyph != nullptr ? glyph->width : 0;
+    placed_.push_back({codepoint, penX_, glyphWidth});
+    penX_ += glyphWidth;
+  }
+  int32_t target = scroll >= 0 ? scroll : std::max<int32_t>(0, penX_ - width);
+  int32_t shift = target - windowX_;
+  if (shift != 0) {
+    windowX_ = target;
+    if (shift >= width || -shift >= width) {
+      sprite_->fillSprite(backgroundColor_);
+      drawTickerRange(0, width);
+      return;
+    }
+    // keep the pixels still inside the window, draw what scrolled in
+    sprite_->scroll(-shift, 0);
+    if (shift > 0) {
+      drawTickerRange(width - shift, width);
+    } else {
+      drawTickerRange(0, -shift);
+    }
+  }
+  drawTickerRange(std::max<int32_t>(0, oldEnd - windowX_),
+                  std::min<int32_t>(width, penX_ - windowX_));
+}
+
+void SpeechCanvas::drawTickerRange(int32_t left, int32_t right) {
+  if (left >= right) {
+    return;
+  }
+  sprite_->setClipRect(left, 0, right - left, sprite_->height());
+  // the first glyph reaching into the range
+  auto it = std::upper_bound(placed_.begin(), placed_.end(), left + windowX_,
+                             [](int32_t x, const Placed &placed) {
+                               return x < placed.x + placed.width;
+                             });
+  for (; it != placed_.end() && it->x - windowX_ < right; ++it) {
+    drawGlyph(it->codepoint, it->x - windowX_, 0);
+  }
+  sprite_->clearClipRect();
+}
+
+}  // namespace m5avatar
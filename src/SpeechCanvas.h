@@ -0,0 +1,106 @@
+// Copyright (c) Shinya Ishikawa. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full
+// license information.
+
+#ifndef SPEECHCANVAS_H_
+#define SPEECHCANVAS_H_
+#define LGFX_USE_V1
+#include <M5GFX.h>
+
+#include <vector>
+
+#include "DrawContext.h"
+#include "GlyphCache.h"
+
+#ifndef ARDUINO
+#include <string>
+typedef std::string String;
+#endif  // ARDUINO
+
+namespace m5avatar {
+/**
+ * @brief The speech text rendered into its own sprite
+ *
+ * When the new text extends the last one, only the added glyphs are laid
+ * out and drawn: Line copies the line into a sprite grown by their width,
+ * Wrap breaks them into the lines at word boundaries (anywhere in CJK text)
+ * and scrolls the lines up when the last one is full, Ticker shifts the
+ * rendered pixels to move its window. Any other change renders the text
+ * again.
+ */
+class SpeechCanvas {
+ private:
+  // a glyph laid out on the line
+  struct Placed {
+    uint32_t codepoint;
+    int32_t x;
+    int16_t width;
+  };
+
+  // Line moves the text to the other canvas when it grows
+  M5Canvas canvases_[2];
+  M5Canvas *sprite_;
+  GlyphCache glyphs_;
+  // inputs other than the text the sprite was rendered with
+  uint32_t styleKey_;
+  bool rendered_;
+  // Line: the sprite holds the glyphs of text_ up to penX_
+  bool lineGlyphs_;
+  // the text laid out so far
+  String text_;
+  // Line: unused, Wrap: the glyphs of the unfinished word, Ticker: all
+  std::vector<Placed> placed_;
+  int32_t penX_;
+  int16_t line_;
+  // Ticker: x of the line at the left edge of the sprite
+  int32_t windowX_;
+
+  // style of the current text
+  const lgfx::IFont *font_;
+  float textSize_;
+  uint16_t primaryColor_;
+  uint16_t backgroundColor_;
+
+  uint32_t measureKey_;
+  int16_t measuredWidth_;
+
+  bool reset(int16_t width, int16_t height, int colorDepth);
+  void drawGlyph(uint32_t codepoint, int32_t x, int32_t y);
+  bool renderLine(const char *text);
+  bool appendLine(const char *text, int16_t width);
+  void appendWrapped(const char *text, int16_t lines);
+  void newLine(int16_t lines);
+  void appendTicker(const char *text, int32_t scroll);
+  void drawTickerRange(int32_t left, int32_t right);
+
+ public:
+  SpeechCanvas();
+  ~SpeechCanvas() = default;
+  SpeechCanvas(const SpeechCanvas &other) = delete;
+  SpeechCanvas &operator=(const SpeechCanvas &other) = delete;
+
+  /**
+   * @brief Bring the sprite up to date with the text
+   *
+   * @param width width of the sprite in Wrap and Ticker, Line sizes the
+   * sprite to the text
+   * @param lines number of lines in Wrap
+   * @param scroll Ticker only, x of the text at the left edge of the sprite,
+   * negative to follow the end of the text
+   * @return false if the sprite could not be allocated
+   */
+  bool update(const char *text, const lgfx::IFont *font, float textSize,
+              SpeechLayout layout, int32_t scroll, int16_t width,
+              int16_t lines, uint16_t primaryColor, uint16_t backgroundColor,
+              int colorDepth);
+  // width of the text on one line, cached for the last text
+  int16_t measure(const char *text, const lgfx::IFont *font, float textSize);
+  int16_t getLineHeight(const lgfx::IFont *font, float textSize);
+  // the sprite of the text, Line may switch to another one in update()
+  M5Canvas *getSprite();
+  GlyphCache *getGlyphCache();
+};
+
+}  // namespace m5avatar
+
+#endif  // SPEECHCANVAS_H_
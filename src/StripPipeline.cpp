@@ -0,0 +1,295 @@
+// Copyright (c) Shinya Ishikawa. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full
+// license information.
+
+#include "StripPipeline.h"
+
+namespace m5avatar {
+
+// fill the strip with the face at the display area starting at (x, y)
+static void sampleStrip(M5Canvas *strip, const StripSource &source, int16_t x,
+                        int16_t y, int16_t w) {
+  if (source.renderer != nullptr) {
+    source.renderer->render(strip, source, x, y, w);
+    return;
+  }
+  // strip position of the canvas center
+  float centerX = source.centerX - x;
+  float centerY = source.centerY - y;
+  if (source.mode != BlitMode::RotateZoom) {
+    // without rotation and zoom the canvas rows are copied as they are
+    if (source.rotation == 0.0f && source.scale == 1.0f) {
+      int16_t left = lroundf(centerX - source.canvas->width() / 2.0f);
+      int16_t top = lroundf(centerY - source.canvas->height() / 2.0f);
+      // a full frame also clears where the last one was, which may reach
+      // past the canvas: the strip is cleared first unless it lies inside
+      bool inside = left <= 0 && top <= 0 &&
+                    left + source.canvas->width() >= w &&
+                    top + source.canvas->height() >= strip->height();
+      if (!inside) {
+        strip->fillRect(0, 0, w, strip->height(), source.bgColor);
+      }
+      if (copyToStrip(source.canvas, -left, -top, w, strip->height(), strip,
+                      source.fgColor, source.bgColor)) {
+        return;
+      }
+    } else if (source.mode == BlitMode::Affine &&
+               affineToStrip(source.canvas, centerX, centerY, source.rotation,
+                             source.scale, w, strip, source.fgColor,
+                             source.bgColor)) {
+      return;
+    }
+  }
+  // 背景色で塗り潰し
+  strip->setBaseColor(source.bgColor);
+  strip->clear();
+  // 傾きとズームを反映してspriteからtmpSpriteに転写
+  source.canvas->pushRotateZoom(strip, centerX, centerY, source.rotation,
+                                source.scale, source.scale);
+}
+
+// fill the strip with the display area starting at (x, y)
+static void fillStrip(M5Canvas *strip, const StripSource &source, int16_t x,
+                      int16_t y, int16_t w) {
+  sampleStrip(strip, source, x, y, w);
+  M5Canvas *overlay = source.overlay;
+  if (overlay == nullptr) {
+    return;
+  }
+  int32_t left = source.overlayX - x;
+  int32_t top = source.overlayY - y;
+  if (left < w && left + overlay->width() > 0 && top < strip->height() &&
+      top + overlay->height() > 0) {
+    overlay->pushSprite(strip, left, top);
+  }
+}
+
+#ifdef SDL_h_
+typedef SDL_sem *Signal;
+typedef SDL_Thread *Thread;
+typedef int ThreadResult;
+static Signal createSignal() { return SDL_CreateSemaphore(0); }
+static void deleteSignal(Signal signal) { SDL_DestroySemaphore(signal); }
+static void notify(Signal signal) { SDL_SemPost(signal); }
+static void await(Signal signal) { SDL_SemWait(signal); }
+#else
+typedef SemaphoreHandle_t Signal;
+typedef TaskHandle_t Thread;
+typedef void ThreadResult;
+static Signal createSignal() { return xSemaphoreCreateBinary(); }
+static void deleteSignal(Signal signal) { vSemaphoreDelete(signal); }
+static void notify(Signal signal) { xSemaphoreGive(signal); }
+static void await(Signal signal) { xSemaphoreTake(signal, portMAX_DELAY); }
+#endif
+
+/**
+ * A thread filling one strip at a time for the pipeline
+ */
+class StripWorker {
+ private:
+  Thread thread_;
+  Signal start_;
+  Signal done_;
+  bool running_;
+  M5Canvas *strip_;
+  const StripSource *source_;
+  int16_t x_;
+  int16_t y_;
+  int16_t w_;
+
+  static ThreadResult loop(void *args) {
+    StripWorker *worker = reinterpret_cast<StripWorker *>(args);
+    while (true) {
+      await(worker->start_);
+      if (!worker->running_) {
+        break;
+      }
+      fillStrip(worker->strip_, *worker->source_, worker->x_, worker->y_,
+                worker->w_);
+      notify(worker->done_);
+    }
+    notify(worker->done_);
+#ifdef SDL_h_
+    return 0;
+#else
+    vTaskDelete(NULL);
+#endif
+  }
+
+ public:
+  StripWorker()
+      : thread_(nullptr),
+        start_(createSignal()),
+        done_(createSignal()),
+        running_(true),
+        strip_(nullptr),
+        source_(nullptr),
+        x_(0),
+        y_(0),
+        w_(0) {
+#ifdef SDL_h_
+    thread_ = SDL_CreateThreadWithStackSize(loop, "stripWorker", 4096, this);
+#else
+    // run on the other core than the draw task, at the same priority
+    xTaskCreatePinnedToCore(loop, "stripWorker", 4096, this,
+                            uxTaskPriorityGet(NULL), &thread_,
+                            (xPortGetCoreID() + 1) % portNUM_PROCESSORS);
+#endif
+  }
+
+  ~StripWorker() {
+    running_ = false;
+    notify(start_);
+    await(done_);
+#ifdef SDL_h_
+    SDL_WaitThread(thread_, nullptr);
+#endif
+    deleteSignal(start_);
+    deleteSignal(done_);
+  }
+
+  StripWorker(const StripWorker &other) = delete;
+  StripWorker &operator=(const StripWorker &other) = delete;
+
+  // start filling the strip; the source must live until wait() returns
+  void run(M5Canvas *strip, const StripSource *source, int16_t x, int16_t y,
+           int16_t w) {
+    strip_ = strip;
+    source_ = source;
+    x_ = x;
+    y_ = y;
+    w_ = w;
+    notify(start_);
+  }
+
+  // wait until the strip given to run() is filled
+  void wait() { await(done_); }
+};
+
+StripPipeline::StripPipeline(M5Canvas *first, M5Canvas *second)
+    : strips_{first, second},
+      workers_{},
+      threads_{1},
+      height_{8},
+      width_{0},
+      stats_{nullptr} {}
+
+StripPipeline::~StripPipeline() {
+  for (StripWorker *worker : workers_) {
+    delete worker;
+  }
+  for (M5Canvas *strip : strips_) {
+    delete strip;
+  }
+}
+
+void StripPipeline::setHeight(uint8_t rows) {
+  height_ = rows > 0 ? rows : 1;
+}
+
+uint8_t StripPipeline::getHeight() const { return height_; }
+
+void StripPipeline::setThreadCount(uint8_t threads) {
+  threads_ = std::max<uint8_t>(1, std::min(threads, kMaxThreads));
+}
+
+uint8_t StripPipeline::getThreadCount() const { return threads_; }
+
+void StripPipeline::setFrameStats(FrameStats *stats) { stats_ = stats; }
+
+int StripPipeline::getBufferCount() const { return threads_ * 2; }
+
+bool StripPipeline::prepare(lgfx::LovyanGFX *display, int16_t width) {
+  // the buffers only grow, so a rotating face does not reallocate them
+  int16_t target = std::max(width, width_);
+  bool ready = true;
+  for (int i = 0; i < kMaxBuffers; i++) {
+    if (i >= getBufferCount()) {
+      // release the buffers of the threads no longer used
+      if (strips_[i] != nullptr) {
+        strips_[i]->deleteSprite();
+      }
+      continue;
+    }
+    if (strips_[i] == nullptr) {
+      strips_[i] = new M5Canvas(display);
+    }
+    M5Canvas *strip = strips_[i];
+    if (strip->getBuffer() != nullptr && strip->width() == target &&
+        strip->height() == height_ &&
+        strip->getColorDepth() == display->getColorDepth()) {
+      continue;
+    }
+    strip->deleteSprite();
+    // 出力先と同じcolorDepthを指定することで、DMA転送が可能になる。
+    // Display自体は16bit or 24bitしか指定できないが、細長なので1bitではなくても大丈夫。
+    strip->setColorDepth(display->getColorDepth());
+    // 確保するメモリは高さ8ピクセル(height_)の横長の細長い短冊状とする。
+    if (strip->createSprite(target, height_) == nullptr) {
+      M5_LOGE("failed to allocate %dx%d strip buffer", target, height_);
+      ready = false;
+    }
+  }
+  for (int i = 1; i < kMaxThreads; i++) {
+    if (i < threads_ && workers_[i] == nullptr) {
+      workers_[i] = new StripWorker();
+    } else if (i >= threads_ && workers_[i] != nullptr) {
+      delete workers_[i];
+      workers_[i] = nullptr;
+    }
+  }
+  width_ = ready ? target : 0;
+  return ready;
+}
+
+void StripPipeline::push(lgfx::LovyanGFX *display,
+                         const StripSource &source, BoundingRect area) {
+  // the strips may be wider than the area, so the display is clipped to the
+  // area to transfer only what changed
+  int32_t clipX, clipY, clipW, clipH;
+  display->getClipRect(&clipX, &clipY, &clipW, &clipH);
+
+  // 事前にstartWriteしておくことで、pushSprite はDMA転送を開始するとすぐに処理を終えて戻ってくる。
+  // The transaction is held for the whole area, so the next strips are
+  // resampled while the previous ones are still being transferred. Each
+  // round fills threads_ strips, and a buffer is refilled only after
+  // threads_ more pushes, each of which waits for the transfer before it.
+  display->startWrite();
+  int bufferCount = getBufferCount();
+  int next = 0;
+  int roundHeight = height_ * threads_;
+  for (int y = area.getTop(); y < area.getBottom(); y += roundHeight) {
+    int count = std::min<int>(
+        threads_, (area.getBottom() - y + height_ - 1) / height_);
+    {
+      M5AVATAR_PROBE(stats_, FramePhase::Resample);
+      for (int i = 1; i < count; i++) {
+        workers_[i]->run(strips_[(next + i) % bufferCount], &source,
+                         area.getLeft(), y + i * height_, area.getWidth());
+      }
+      fillStrip(strips_[next], source, area.getLeft(), y, area.getWidth());
+    }
+    for (int i = 0; i < count; i++) {
+      if (i > 0) {
+        M5AVATAR_PROBE(stats_, FramePhase::Resample);
+        workers_[i]->wait();
+      }
+      M5AVATAR_PROBE(stats_, FramePhase::Transfer);
+      int stripY = y + i * height_;
+      display->setClipRect(area.getLeft(), stripY, area.getWidth(),
+                           std::min<int>(height_, area.getBottom() - stripY));
+      strips_[(next + i) % bufferCount]->pushSprite(display, area.getLeft(),
+                                                    stripY);
+    }
+    next = (next + threads_) % bufferCount;
+  }
+  // endWriteによってDMA転送の終了を待つ。
+  {
+    M5AVATAR_PROBE(stats_, FramePhase::Transfer);
+    display->endWrite();
+  }
+
+  display->setClipRect(clipX, clipY, clipW, clipH);
+}
+
+}  // namespace m5avatar
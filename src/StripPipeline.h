@@ -0,0 +1,145 @@
+// Copyright (c) Shinya Ishikawa. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full
+// license information.
+
+#ifndef STRIPPIPELINE_H_
+#define STRIPPIPELINE_H_
+#define LGFX_USE_V1
+#include <M5GFX.h>
+
+#include "Blitter.h"
+#include "BoundingRect.h"
+#include "FrameStats.h"
+
+namespace m5avatar {
+
+/**
+ * How the canvas is transferred into the strips pushed to the display
+ */
+enum class BlitMode {
+  // copy rows straight into the display format while the face is neither
+  // rotated nor scaled, resample with pushRotateZoom otherwise
+  Auto,
+  // always resample with pushRotateZoom
+  RotateZoom,
+  // like Auto, but resample with the fixed-point affineToStrip instead of
+  // pushRotateZoom while the face is rotated or scaled
+  Affine
+};
+
+class StripRenderer;
+
+/**
+ * What the strips are sampled from
+ */
+struct StripSource {
+  // nullptr when renderer draws the strips
+  M5Canvas *canvas;
+  float rotation;
+  float scale;
+  BlitMode mode;
+  // colors of the 1-bit canvas palette
+  uint16_t fgColor;
+  uint16_t bgColor;
+  // display position of the canvas center, which rotation and zoom are
+  // applied around
+  float centerX;
+  float centerY;
+  // draws each strip instead of sampling the canvas, nullptr for none
+  const StripRenderer *renderer;
+  // drawn upright over the strips at its display position, nullptr for none
+  M5Canvas *overlay;
+  int16_t overlayX;
+  int16_t overlayY;
+};
+
+/**
+ * Draws the strips of a face that has no canvas of its own
+ *
+ * Called from the worker threads at the same time, each with its own strip,
+ * so render() must not change the renderer.
+ */
+class StripRenderer {
+ public:
+  virtual ~StripRenderer() = default;
+  /**
+   * @brief Fill the first w columns of the strip with the display area at
+   * (x, y)
+   */
+  virtual void render(M5Canvas *strip, const StripSource &source, int16_t x,
+                      int16_t y, int16_t w) const = 0;
+};
+
+class StripWorker;
+
+/**
+ * Transfers the canvas to the display through short horizontal strips
+ *
+ * Strip buffers in the display's color depth are used in turn: while one
+ * strip is transferred by DMA, the next ones are resampled into the other
+ * buffers. With more than one thread, the strips of each round are
+ * resampled in parallel by worker threads (the other core on ESP32), and
+ * the calling thread alone pushes them to the display in order.
+ */
+class StripPipeline {
+ public:
+#if defined(SDL_h_)
+  static constexpr uint8_t kMaxThreads = 4;
+#elif defined(portNUM_PROCESSORS)
+  static constexpr uint8_t kMaxThreads = portNUM_PROCESSORS;
+#else
+  static constexpr uint8_t kMaxThreads = 1;
+#endif
+
+ private:
+  // two buffers per thread: one being filled, one being transferred
+  static constexpr int kMaxBuffers = kMaxThreads * 2;
+  M5Canvas *strips_[kMaxBuffers];
+  // workers_[0] stays empty: the calling thread fills the first strip
+  StripWorker *workers_[kMaxThreads];
+  uint8_t threads_;
+  uint8_t height_;
+  int16_t width_;
+  FrameStats *stats_;
+
+  int getBufferCount() const;
+
+ public:
+  // takes the ownership of both buffers
+  StripPipeline(M5Canvas *first, M5Canvas *second);
+  ~StripPipeline();
+  StripPipeline(const StripPipeline &other) = delete;
+  StripPipeline &operator=(const StripPipeline &other) = delete;
+
+  // rows of each strip, 8 by default
+  void setHeight(uint8_t rows);
+  uint8_t getHeight() const;
+
+  // threads resampling the strips, 1 (the calling thread only) by default
+  void setThreadCount(uint8_t threads);
+  uint8_t getThreadCount() const;
+
+  // where the resample and transfer times go, see M5AVATAR_FRAME_STATS
+  void setFrameStats(FrameStats *stats);
+
+  /**
+   * @brief (Re)allocate the strip buffers and start the workers if the
+   * buffers are narrower than width, or the height, the thread count or the
+   * display's color depth changed
+   *
+   * @return false if the buffers could not be allocated
+   */
+  bool prepare(lgfx::LovyanGFX *display, int16_t width);
+
+  /**
+   * @brief Push an area of the display from the transformed canvas
+   *
+   * @param area display area, no wider than the width given to prepare()
+   */
+  void push(lgfx::LovyanGFX *display, const StripSource &source,
+            BoundingRect area);
+};
+
+}  // namespace m5avatar
+
+#endif  // STRIPPIPELINE_H_
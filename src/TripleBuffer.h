@@ -0,0 +1,61 @@
+// Copyright (c) Shinya Ishikawa. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full
+// license information.
+
+#ifndef TRIPLEBUFFER_H_
+#define TRIPLEBUFFER_H_
+#include <atomic>
+#include <cstdint>
+
+namespace m5avatar {
+/**
+ * @brief Hand values over from one writer to one reader without locks
+ *
+ * The writer fills back() and publishes it; the reader takes the newest
+ * published value with read(). Each side owns one of the three slots and
+ * the third is exchanged atomically between them, so neither side ever
+ * waits for the other and the reader never sees a half-written value.
+ * Values published before the reader catches up are dropped.
+ *
+ * Several writers must be serialized by the caller.
+ */
+template <typename T>
+class TripleBuffer {
+ private:
+  static constexpr uint8_t kIndexMask = 0x03;
+  // set on the exchanged slot when it holds a value the reader has not seen
+  static constexpr uint8_t kFresh = 0x04;
+
+  T slots_[3];
+  uint8_t back_;
+  std::atomic<uint8_t> middle_;
+  uint8_t front_;
+
+ public:
+  TripleBuffer() : back_{0}, middle_{1}, front_{2} {}
+  ~TripleBuffer() = default;
+  TripleBuffer(const TripleBuffer &other) = delete;
+  TripleBuffer &operator=(const TripleBuffer &other) = delete;
+
+  // slot to fill before publish(), owned by the writer
+  T &back() { return slots_[back_]; }
+
+  // make the back slot the newest value and take another one to fill
+  void publish() {
+    back_ = middle_.exchange(back_ | kFresh, std::memory_order_acq_rel) &
+            kIndexMask;
+  }
+
+  // the newest published value, owned by the reader until the next read()
+  T &read() {
+    if (middle_.load(std::memory_order_acquire) & kFresh) {
+      front_ = middle_.exchange(front_, std::memory_order_acq_rel) &
+               kIndexMask;
+    }
+    return slots_[front_];
+  }
+};
+
+}  // namespace m5avatar
+
+#endif  // TRIPLEBUFFER_H_
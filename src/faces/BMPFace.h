@@ -19,7 +19,7 @@ class BMPEye : public Drawable
 {
   void draw(M5Canvas *spi, BoundingRect rect, DrawContext *ctx)
   {
-    uint16_t color = ctx->getColorDepth() == 1 ? 1 : ctx->getColorPalette()->get(COLOR_PRIMARY);
+    uint16_t color = ctx->getColor(ColorKey::Primary);
     uint16_t cx = rect.getCenterX();
     uint16_t cy = rect.getCenterY();
     float openRatio = ctx->getEyeOpenRatio();
@@ -45,7 +45,7 @@ class BMPEye : public Drawable
 class BMPFace : public Face
 {
 public:
-  BMPFace(M5GFX* display = &M5.Display)
+  BMPFace(lgfx::LovyanGFX *display = &M5.Display)
       : Face(new Mouth(50, 90, 4, 60), new BoundingRect(148, 163),
              new BMPEye(),
              new BoundingRect(103, 80), new BMPEye(),
@@ -18,12 +18,8 @@ class DogEye : public Drawable {
         uint32_t cx = rect.getCenterX();
         uint32_t cy = rect.getCenterY();
         Gaze g = ctx->getLeftGaze();
-        ColorPalette *cp = ctx->getColorPalette();
-        uint16_t primaryColor =
-            ctx->getColorDepth() == 1 ? 1 : cp->get(COLOR_PRIMARY);
-        uint16_t backgroundColor = ctx->getColorDepth() == 1
-                                       ? ERACER_COLOR
-                                       : cp->get(COLOR_BACKGROUND);
+        uint16_t primaryColor = ctx->getColor(ColorKey::Primary);
+        uint16_t backgroundColor = ctx->getColor(ColorKey::Background);
         uint32_t offsetX = g.getHorizontal() * 8;
         uint32_t offsetY = g.getVertical() * 5;
         float eor = ctx->getLeftEyeOpenRatio();
@@ -58,14 +54,8 @@ class DogMouth : public Drawable {
           minHeight{minHeight},
           maxHeight{maxHeight} {}
     void draw(M5Canvas *spi, BoundingRect rect, DrawContext *ctx) {
-        uint16_t primaryColor =
-            ctx->getColorDepth() == 1
-                ? 1
-                : ctx->getColorPalette()->get(COLOR_PRIMARY);
-        uint16_t backgroundColor =
-            ctx->getColorDepth() == 1
-                ? ERACER_COLOR
-                : ctx->getColorPalette()->get(COLOR_BACKGROUND);
+        uint16_t primaryColor = ctx->getColor(ColorKey::Primary);
+        uint16_t backgroundColor = ctx->getColor(ColorKey::Background);
         uint32_t cx = rect.getCenterX();
         uint32_t cy = rect.getCenterY();
         float openRatio = ctx->getMouthOpenRatio();
@@ -86,7 +76,7 @@ class DogMouth : public Drawable {
 
 class DogFace : public Face {
    public:
-    DogFace(M5GFX* display = &M5.Display)
+    DogFace(lgfx::LovyanGFX *display = &M5.Display)
         : Face(new DogMouth(), new BoundingRect(168, 163), new DogEye(),
                new BoundingRect(103, 80), new DogEye(),
                new BoundingRect(106, 240), new Eyeblow(15, 2, false),
@@ -13,7 +13,7 @@ namespace m5avatar {
  */
 class SimpleFace : public Face {
    public:
-    SimpleFace()
+    SimpleFace(lgfx::LovyanGFX *display = &M5.Display)
         : Face(new RectMouth(50, 90, 4, 60), new BoundingRect(148, 163),
                // right eye, second eye arg is center position of eye in (y,x)
                new EllipseEye(16, 16, false), new BoundingRect(93, 90),
@@ -21,7 +21,8 @@ class SimpleFace : public Face {
                new EllipseEye(16, 16, true), new BoundingRect(96, 230),
                //  hide eye brows with setting these height zero
                new EllipseEyebrow(0, 0, false), new BoundingRect(67, 96),
-               new EllipseEyebrow(0, 0, true), new BoundingRect(72, 230)) {}
+               new EllipseEyebrow(0, 0, true), new BoundingRect(72, 230),
+               display) {}
 };
 /**
  * @brief face template for "OωO" face
@@ -29,7 +30,7 @@ class SimpleFace : public Face {
  */
 class OmegaFace : public Face {
    public:
-    OmegaFace()
+    OmegaFace(lgfx::LovyanGFX *display = &M5.Display)
         : Face(new OmegaMouth(), new BoundingRect(225, 160),
                // right eye, second eye arg is center position of eye in (y,x)
                new EllipseEye(false), new BoundingRect(165, 84),
@@ -37,12 +38,13 @@ class OmegaFace : public Face {
                new EllipseEye(true), new BoundingRect(165, 84 + 154),
                //  hide eye brows with setting these height zero
                new EllipseEyebrow(0, 0, false), new BoundingRect(67, 96),
-               new EllipseEyebrow(0, 0, true), new BoundingRect(72, 230)) {}
+               new EllipseEyebrow(0, 0, true), new BoundingRect(72, 230),
+               display) {}
 };
 
 class GirlyFace : public Face {
    public:
-    GirlyFace()
+    GirlyFace(lgfx::LovyanGFX *display = &M5.Display)
         : Face(new UShapeMouth(44, 44, 0, 16), new BoundingRect(222, 160),
                // right eye, second eye arg is center position of eye
                new GirlyEye(84, 84, false), new BoundingRect(163, 64),
@@ -54,12 +56,13 @@ class GirlyFace : public Face {
                new BoundingRect(97 + 10, 84 + 18),  // (y,x)
                                                     //  left eyebrow
                new EllipseEyebrow(36, 20, true),
-               new BoundingRect(107, 200 + 18)) {}
+               new BoundingRect(107, 200 + 18),
+               display) {}
 };
 
 class GirlyFace2 : public Face {
    public:
-    GirlyFace2()
+    GirlyFace2(lgfx::LovyanGFX *display = &M5.Display)
         : Face(new UShapeMouth(44, 44, 0, 16), new BoundingRect(222, 160),
                // right eye, second eye arg is center position of eye
                new GirlyEye(84, 84, false), new BoundingRect(163, 64),
@@ -70,12 +73,13 @@ class GirlyFace2 : public Face {
                new BowEyebrow(160, 160, false),
                new BoundingRect(163, 64),  // (y,x)
                                            //  left eyebrow
-               new BowEyebrow(160, 160, true), new BoundingRect(163, 256)) {}
+               new BowEyebrow(160, 160, true), new BoundingRect(163, 256),
+               display) {}
 };
 
 class PinkDemonFace : public Face {
    public:
-    PinkDemonFace()
+    PinkDemonFace(lgfx::LovyanGFX *display = &M5.Display)
         : Face(new UShapeMouth(64, 64, 0, 16), new BoundingRect(214, 160),
                // right eye, second eye arg is center position of eye
                new PinkDemonEye(52, 134, false), new BoundingRect(134, 106),
@@ -84,12 +88,13 @@ class PinkDemonFace : public Face {
 
                //  hide eye brows with setting these height zero
                new EllipseEyebrow(15, 0, false), new BoundingRect(67, 96),
-               new EllipseEyebrow(15, 0, true), new BoundingRect(72, 230)) {}
+               new EllipseEyebrow(15, 0, true), new BoundingRect(72, 230),
+               display) {}
 };
 
 class DoggyFace : public Face {
    public:
-    DoggyFace()
+    DoggyFace(lgfx::LovyanGFX *display = &M5.Display)
         : Face(new DoggyMouth(50, 90, 4, 60), new BoundingRect(168, 163),
                // right eye, second eye arg is center position of eye
                new DoggyEye(false), new BoundingRect(103, 80),
@@ -97,7 +102,8 @@ class DoggyFace : public Face {
                new DoggyEye(true), new BoundingRect(106, 240),
                //  hide eye brows with setting these height zero
                new RectEyebrow(15, 2, false), new BoundingRect(67, 96),
-               new RectEyebrow(15, 2, true), new BoundingRect(72, 230)) {}
+               new RectEyebrow(15, 2, true), new BoundingRect(72, 230),
+               display) {}
 };
 
 }  // namespace m5avatar
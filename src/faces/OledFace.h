@@ -13,7 +13,7 @@
 namespace m5avatar {
 class OledFace : public Face {
  public:
-  OledFace(M5GFX* display = &M5.Display)
+  OledFace(lgfx::LovyanGFX *display = &M5.Display)
       : Face(new Mouth(50, 90, 4, 60), new BoundingRect(168, 163), new Eye(8, false),
              new BoundingRect(103, 80), new Eye(8, true),
              new BoundingRect(106, 240), new Eyeblow(15, 2, false),